@@ -0,0 +1,340 @@
+/*
+ * CPython extension over re.h, for Python 3.
+ *
+ *   import tre
+ *   p = tre.compile(rb"\d+ms")
+ *   p.search(buf)          # (start, end) or None
+ *   p.find_all(buf)        # [(start, end), ...]
+ *   p.search_batch(bufs)   # [(start, end) or None, ...]
+ *
+ * Texts are any contiguous buffer: bytes, bytearray, memoryview or mmap, read
+ * in place and never copied. Matches are byte offsets into them. The GIL is
+ * released while matching, so threads searching at once run in parallel, and
+ * the buffers are held until the match is done so they cannot be resized or
+ * closed under it. The empty pattern, which re.h does not compile, matches
+ * the empty string at the start of every text.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#define TRE_SILENT // errors are raised as tre.error
+#define TRE_IMPLEMENTATION
+#include "re.h"
+
+
+#define TRE_PY_SCRATCH 16384 // bytes of lazy DFA cache on the stack of each search
+
+typedef struct
+{
+    PyObject_HEAD
+    PyObject *pattern; // bytes
+    int anchored;      // pattern starts with '^'
+    int any;           // the empty pattern, matching every text
+    int nullable;      // matches the empty text
+    tre_comp tregex;
+} PatternObject;
+
+static PyObject *tre_error; // tre.error
+
+// Match [start, end) of tregex in text, or -1 in start. Called without the GIL.
+static void search(const PatternObject *p, const char *text, Py_ssize_t len, Py_ssize_t *start, Py_ssize_t *end)
+{
+    unsigned char mem[TRE_PY_SCRATCH];
+    const char *m, *e;
+
+    *start = *end = -1;
+    if (!len || p->any)
+    {
+        if (p->nullable)
+            *start = *end = 0;
+        return;
+    }
+    m = tre_nmatch_mem(&p->tregex, text, (size_t)len, &e, mem, sizeof(mem));
+    if (m)
+    {
+        *start = m - text;
+        *end = e - text;
+    }
+}
+
+static PyObject *span(Py_ssize_t start, Py_ssize_t end)
+{
+    if (start < 0)
+        Py_RETURN_NONE;
+    return Py_BuildValue("(nn)", start, end);
+}
+
+static PyObject *pattern_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
+{
+    static char *kwlist[] = { "pattern", NULL };
+    PatternObject *p;
+    PyObject *arg, *bytes;
+    const char *pat;
+    Py_ssize_t plen;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "O:Pattern", kwlist, &arg))
+        return NULL;
+    if (PyUnicode_Check(arg))
+        bytes = PyUnicode_AsUTF8String(arg);
+    else
+        bytes = PyBytes_FromObject(arg);
+    if (!bytes)
+        return NULL;
+
+    p = (PatternObject *)type->tp_alloc(type, 0);
+    if (!p)
+    {
+        Py_DECREF(bytes);
+        return NULL;
+    }
+    p->pattern = bytes;
+    pat = PyBytes_AS_STRING(bytes);
+    plen = PyBytes_GET_SIZE(bytes);
+    p->any = !plen;
+    if (!p->any && !tre_ncompile(pat, (size_t)plen, &p->tregex))
+    {
+        PyErr_Format(tre_error, "pattern %R does not compile", bytes);
+        Py_DECREF(p);
+        return NULL;
+    }
+    p->anchored = plen && pat[0] == '^';
+    p->nullable = p->any || tre_nullable(&p->tregex);
+    return (PyObject *)p;
+}
+
+static void pattern_dealloc(PatternObject *p)
+{
+    Py_XDECREF(p->pattern);
+    Py_TYPE(p)->tp_free((PyObject *)p);
+}
+
+static PyObject *pattern_repr(PatternObject *p)
+{
+    return PyUnicode_FromFormat("tre.compile(%R)", p->pattern);
+}
+
+PyDoc_STRVAR(search_doc,
+"search(buffer) -> (start, end) or None\n\n"
+"Leftmost match in buffer, as byte offsets.");
+
+static PyObject *pattern_search(PatternObject *p, PyObject *arg)
+{
+    Py_buffer view;
+    Py_ssize_t start, end;
+
+    if (PyObject_GetBuffer(arg, &view, PyBUF_SIMPLE) < 0)
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    search(p, view.buf, view.len, &start, &end);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+    return span(start, end);
+}
+
+PyDoc_STRVAR(find_all_doc,
+"find_all(buffer) -> list of (start, end)\n\n"
+"All matches in buffer, each searched for from the end of the last. An empty\n"
+"match is followed by a search from the next byte, and a '^' pattern matches\n"
+"at most once.");
+
+static PyObject *pattern_find_all(PatternObject *p, PyObject *arg)
+{
+    Py_buffer view;
+    Py_ssize_t *spans = NULL, *grown;
+    Py_ssize_t n = 0, cap = 0, from = 0, start, end, i;
+    PyObject *list = NULL, *item;
+    int nomem = 0;
+
+    if (PyObject_GetBuffer(arg, &view, PyBUF_SIMPLE) < 0)
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    while (from <= view.len)
+    {
+        search(p, (const char *)view.buf + from, view.len - from, &start, &end);
+        if (start < 0)
+            break;
+        if (n == cap)
+        {
+            cap = cap ? 2 * cap : 16;
+            grown = PyMem_RawRealloc(spans, (size_t)cap * 2 * sizeof(*spans));
+            if (!grown)
+            {
+                nomem = 1;
+                break;
+            }
+            spans = grown;
+        }
+        spans[2 * n] = from + start;
+        spans[2 * n + 1] = from + end;
+        n++;
+        if (p->anchored)
+            break;
+        from += end + (start == end ? 1 : 0);
+    }
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&view);
+
+    if (nomem)
+        PyErr_NoMemory();
+    else if ((list = PyList_New(n)))
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (!(item = span(spans[2 * i], spans[2 * i + 1])))
+            {
+                Py_CLEAR(list);
+                break;
+            }
+            PyList_SET_ITEM(list, i, item);
+        }
+    }
+    PyMem_RawFree(spans);
+    return list;
+}
+
+PyDoc_STRVAR(search_batch_doc,
+"search_batch(buffers) -> list of (start, end) or None\n\n"
+"search() of each buffer in a sequence, all under one release of the GIL.");
+
+static PyObject *pattern_search_batch(PatternObject *p, PyObject *arg)
+{
+    PyObject *seq, *list = NULL, *item;
+    Py_buffer *views;
+    Py_ssize_t *spans;
+    Py_ssize_t n, got, i;
+
+    if (!(seq = PySequence_Fast(arg, "search_batch() takes a sequence of buffers")))
+        return NULL;
+    n = PySequence_Fast_GET_SIZE(seq);
+    views = PyMem_New(Py_buffer, n ? n : 1);
+    spans = PyMem_New(Py_ssize_t, 2 * (n ? n : 1));
+    if (!views || !spans)
+    {
+        PyErr_NoMemory();
+        goto done;
+    }
+    for (got = 0; got < n; got++)
+    {
+        if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, got), &views[got], PyBUF_SIMPLE) < 0)
+            goto release;
+    }
+
+    Py_BEGIN_ALLOW_THREADS
+    for (i = 0; i < n; i++)
+        search(p, views[i].buf, views[i].len, &spans[2 * i], &spans[2 * i + 1]);
+    Py_END_ALLOW_THREADS
+
+    if ((list = PyList_New(n)))
+    {
+        for (i = 0; i < n; i++)
+        {
+            if (!(item = span(spans[2 * i], spans[2 * i + 1])))
+            {
+                Py_CLEAR(list);
+                break;
+            }
+            PyList_SET_ITEM(list, i, item);
+        }
+    }
+
+release:
+    while (got > 0)
+        PyBuffer_Release(&views[--got]);
+done:
+    PyMem_Free(views);
+    PyMem_Free(spans);
+    Py_DECREF(seq);
+    return list;
+}
+
+static PyMethodDef pattern_methods[] =
+{
+    { "search",       (PyCFunction)pattern_search,       METH_O, search_doc },
+    { "find_all",     (PyCFunction)pattern_find_all,     METH_O, find_all_doc },
+    { "search_batch", (PyCFunction)pattern_search_batch, METH_O, search_batch_doc },
+    { NULL, NULL, 0, NULL }
+};
+
+static PyObject *pattern_get_pattern(PatternObject *p, void *closure)
+{
+    (void)closure;
+    Py_INCREF(p->pattern);
+    return p->pattern;
+}
+
+static PyGetSetDef pattern_getset[] =
+{
+    { "pattern", (getter)pattern_get_pattern, NULL, "The pattern, as bytes", NULL },
+    { NULL, NULL, NULL, NULL, NULL }
+};
+
+PyDoc_STRVAR(pattern_doc,
+"Pattern(pattern)\n\n"
+"A compiled re.h pattern, from bytes or a str encoded as UTF-8.");
+
+static PyTypeObject PatternType =
+{
+    PyVarObject_HEAD_INIT(NULL, 0)
+    .tp_name = "tre.Pattern",
+    .tp_basicsize = sizeof(PatternObject),
+    .tp_dealloc = (destructor)pattern_dealloc,
+    .tp_repr = (reprfunc)pattern_repr,
+    .tp_flags = Py_TPFLAGS_DEFAULT,
+    .tp_doc = pattern_doc,
+    .tp_methods = pattern_methods,
+    .tp_getset = pattern_getset,
+    .tp_new = pattern_new,
+};
+
+PyDoc_STRVAR(compile_doc,
+"compile(pattern) -> Pattern\n\n"
+"Compile pattern, raising tre.error if it does not compile.");
+
+static PyObject *tre_py_compile(PyObject *module, PyObject *arg)
+{
+    PyObject *args, *p;
+
+    (void)module;
+    if (!(args = PyTuple_Pack(1, arg)))
+        return NULL;
+    p = pattern_new(&PatternType, args, NULL);
+    Py_DECREF(args);
+    return p;
+}
+
+static PyMethodDef tre_methods[] =
+{
+    { "compile", tre_py_compile, METH_O, compile_doc },
+    { NULL, NULL, 0, NULL }
+};
+
+static struct PyModuleDef tre_module =
+{
+    PyModuleDef_HEAD_INIT, "tre", "Regular expressions of re.h over buffers, without the GIL", -1, tre_methods,
+    NULL, NULL, NULL, NULL
+};
+
+PyMODINIT_FUNC PyInit_tre(void)
+{
+    PyObject *m;
+
+    if (PyType_Ready(&PatternType) < 0 || !(m = PyModule_Create(&tre_module)))
+        return NULL;
+    if (!tre_error)
+        tre_error = PyErr_NewException("tre.error", PyExc_ValueError, NULL);
+    Py_INCREF(&PatternType);
+    if (!tre_error || PyModule_AddObject(m, "Pattern", (PyObject *)&PatternType) < 0)
+    {
+        Py_DECREF(&PatternType);
+        Py_DECREF(m);
+        return NULL;
+    }
+    Py_INCREF(tre_error);
+    if (PyModule_AddObject(m, "error", tre_error) < 0)
+    {
+        Py_DECREF(tre_error);
+        Py_DECREF(m);
+        return NULL;
+    }
+    return m;
+}
@@ -1,4 +1,5 @@
 // #define TRE_SILENT
 // #define TRE_DOTANY
+#define _GNU_SOURCE // memrchr
 #define TRE_IMPLEMENTATION
 #include "re.h"
@@ -10,7 +10,7 @@
 //   '+'        Plus, match one or more (greedy, +? lazy)
 //   '{m,n}'    Quantifier, match min. 'm' and max. 'n' (greedy, {m,n}? lazy)
 //   '{m}'                  exactly 'm'
-//   '{m,}'                 match min 'm' and max. MAX_QUANT
+//   '{m,}'                 min. 'm' and no max., as '*' and '+'
 //   '?'        Question, match zero or one (greedy, ?? lazy)
 // ---------
 //   '.'        Dot, matches any character except newline (\r, \n)
@@ -25,6 +25,17 @@
 //   '\D'       Non-digits
 //   '\X'       Character itself; X in [^sSwWdD] (e.g. '\\' is '\')
 // ---------
+//
+// Patterns are matched by a bit-parallel Shift-And engine in linear time, one
+// bit per expanded position ('a{3}' is 3, 'a*' is 1). Past 64 positions each
+// count, as in '[A-Za-z0-9+/]{4,1000}', is kept in a counter instead. It
+// returns the match the backtracking matcher, which tre_nmatch_safe tries
+// first, would return.
+// Unambiguous '^' patterns, where each byte can only be taken by one node as
+// in '^\d+-\w+$', take a single forward walk instead.
+// Patterns holding a literal, as in '\w+@example\.com', are searched for it
+// with memchr and matched out from there. Fixed-width patterns such as
+// '\d\d:\d\d:\d\d' try 16 starts at once with SSE2 where available.
 
 
 #ifndef TRE_RE_H_INCLUDE
@@ -42,12 +53,34 @@ extern "C" {
 
 #define TRE_MAX_NODES    64  // Max number of regex nodes in expression.
 #define TRE_MAX_BUFLEN  128  // Max length of character-class buffer in.
+#define TRE_MAXQUANT   1024  // Max b in {a,b}. must be <= 1024, the entry times a counter keeps
+#define TRE_MAX_COUNTERS 32  // Max number of counted {m,n} in a Shift-And program, as many as a pattern can hold.
+#define TRE_MAX_ERRORS    8  // Max errors allowed by tre_nmatch_fuzzy.
+#define TRE_MAX_LITLEN   16  // Max length of the literal searched for first.
+#define TRE_MAX_RANGES    4  // Max byte ranges per position of a fixed-width pattern.
+#define TRE_PADDING      64  // Readable bytes past the text for tre_nmatch_padded.
+#define TRE_AGAIN       (-1) // tre_ctx_run stopped before the search was done.
+#define TRE_MAX_DFASTATES 255 // Max states of each scan of a tre_dfa.
+#define TRE_MAX_SET      64  // Max patterns of a tre_set.
+#define TRE_SET_WORDS     4  // 64-bit words of Shift-And state shared by the patterns of a tre_set.
+#define TRE_DFA_BUILDSIZE (sizeof(tre_dfa) + 256 + 3 * TRE_MAX_DFASTATES * 257) // Room tre_dfa_build may need.
 
 //#define TRE_SILENT // disable inclusion of stdio and printing
 //#define TRE_DOTANY // dot matches anything including newline
 
+#include "stddef.h"
+#include "stdint.h"
+
 typedef struct tre_node tre_node;
+typedef struct tre_bits tre_bits;
 typedef struct tre_comp tre_comp;
+typedef struct tre_scratch tre_scratch;
+typedef struct tre_cnt tre_cnt;
+typedef struct tre_pick tre_pick;
+typedef struct tre_ctx tre_ctx;
+typedef struct tre_dfa tre_dfa;
+typedef struct tre_set tre_set;
+typedef struct tre_lexer tre_lexer;
 
 // 8 and 16 bytes on x86 and x86_64 resp.
 struct tre_node
@@ -61,20 +94,235 @@ struct tre_node
     };
 };
 
+// Shift-And program, bit i stands for the i-th expanded position
+struct tre_bits
+{
+    uint64_t opt;       // positions that can be skipped
+    uint64_t rep;       // positions that can repeat
+    uint64_t last;      // positions that can end a match
+    unsigned char ncnt; // number of counted positions
+    unsigned char cpos[TRE_MAX_COUNTERS];  // counted position
+    unsigned short cmin[TRE_MAX_COUNTERS]; // and its count
+    unsigned short cmax[TRE_MAX_COUNTERS];
+    uint64_t mask[256]; // positions accepting a byte
+};
+
 struct tre_comp
 {
     tre_node nodes[TRE_MAX_NODES];
     unsigned char buffer[TRE_MAX_BUFLEN];
+    unsigned short flags; // pattern properties
+    unsigned char npos;  // number of positions in fwd and rev
+    unsigned char litpos, litlen; // position and length of the literal searched for first
+    unsigned char litrare;        // and offset of its rarest byte, which memchr looks for
+    char lit[TRE_MAX_LITLEN];
+    tre_bits fwd, rev;   // forward and reversed position programs
+    unsigned char nrange[64]; // byte ranges lo..lo+span accepted by each position
+    unsigned char rangelo[64][TRE_MAX_RANGES], rangespan[64][TRE_MAX_RANGES]; // of a fixed-width pattern
+    unsigned short nclass;         // byte classes, bytes of a class being alike in fwd and rev
+    unsigned char byteclass[256];  // class of each byte, numbered in order of their first byte
+};
+
+// Working memory of one thread for tre_nmatch_scratch. Matching only reads the
+// tre_comp, so threads can share one, each with a scratch of its own.
+struct tre_scratch
+{
+    void *mem;        // caller memory, allocated once
+    size_t size;      // and its size in bytes
+    size_t nfallback; // searches tre_nmatch_safe handed to a linear-time engine
+};
+
+// Counter registers of a Shift-And scan, see cntstep
+struct tre_cnt
+{
+    size_t t;     // bytes consumed
+    int live;     // a counter has entries
+    struct
+    {
+        size_t since;      // start of the run of bytes the counter takes
+        size_t alive;      // entries in the last max bytes
+        size_t ready;      // and those of at least min bytes
+        uint64_t ring[16]; // entry times modulo 1024, one bit each
+    } k[TRE_MAX_COUNTERS];
+};
+
+// End of a match picked node by node, see bitend
+struct tre_pick
+{
+    const char *last;     // longest match end
+    const char *p, *hi;   // start of the node and end of the bytes it takes
+    const char *q, *pick; // rev scan back from last, null before it, and the end picked
+    unsigned node, pos;   // node and its first position
+    unsigned total;       // expanded positions, see bitwidth
+};
+
+// Search suspended by tre_ctx_run, picked up where it stopped by the next call
+struct tre_ctx
+{
+    const tre_comp *tregex;
+    const char *text, *tend;  // text searched
+    const char *pos;          // where the scan goes on
+    const char *start, *end;  // match once found
+    void *mem;                // lazy DFA cache
+    size_t size;              // and its size in bytes
+    int phase;                // scan under way
+    int scanning;             // state below is set
+    uint64_t d, e;            // Shift-And state of the scan
+    void *st;                 // or DFA state if set
+    unsigned n, cap, s;
+    tre_cnt cnt;
+    tre_pick pick;            // of the end, with greedy and lazy quantifiers
+};
+
+// DFA built by tre_dfa_build, followed by its tables. It holds no pointers, so
+// it can be stored and loaded as is on machines of the same byte order.
+struct tre_dfa
+{
+    char magic[4];            // "tre1"
+    uint32_t size;            // bytes in all, tables included
+    unsigned short flags;     // pattern properties
+    unsigned short nclass;    // byte classes
+    unsigned char nstate[3];  // states of the first, start and last scan
+    unsigned char dead[3];    // their state without a way out, or TRE_MAX_DFASTATES
+};
+
+// Shift-And programs of several patterns packed side by side into the words of
+// one state, each followed by a spare bit, all stepped at once by a byte
+struct tre_set
+{
+    unsigned char n;                    // patterns
+    unsigned char used[TRE_SET_WORDS];  // bits taken in each word
+    unsigned char word[TRE_MAX_SET];    // word of each pattern
+    uint64_t last[TRE_MAX_SET];         // and its positions that can end a match
+    uint64_t null;                      // patterns matching any text with the empty string
+    uint64_t opt[TRE_SET_WORDS], rep[TRE_SET_WORDS];
+    uint64_t enter[TRE_SET_WORDS];      // first positions of the patterns not anchored at start
+    uint64_t begin[TRE_SET_WORDS];      // and of those that are
+    uint64_t lastany[TRE_SET_WORDS];    // positions ending a match anywhere
+    uint64_t lastend[TRE_SET_WORDS];    // or only at the end of text
+    uint64_t mask[256][TRE_SET_WORDS];  // positions accepting a byte
 };
 
-// Compile regex string pattern as tre_comp struct tregex
+// Token rules, all stepped at once from the start of a token
+struct tre_lexer
+{
+    tre_set set;                           // rules
+    unsigned char rule[TRE_SET_WORDS][64]; // rule taking each bit of set
+};
+
+// Compile regex string pattern as tre_comp struct tregex. Returns 0 on errors,
+// among them patterns of more than TRE_MAX_NODES - 1 nodes.
 TRE_DEF int tre_compile(const char *pattern, tre_comp *tregex);
 
+// Same with pattern of length plen
+TRE_DEF int tre_ncompile(const char *pattern, size_t plen, tre_comp *tregex);
+
+// Same picking the literal searched for first by the byte frequencies freq[256],
+// higher for more common bytes, instead of the built-in ones if freq is not null
+TRE_DEF int tre_ncompile_freq(const char *pattern, size_t plen, const unsigned char *freq, tre_comp *tregex);
+
+// Fill freq[256] with the byte frequencies of a sample of len bytes, for tre_ncompile_freq
+TRE_DEF void tre_train_freq(const char *sample, size_t len, unsigned char *freq);
+
 // Match tregex in text and return the match start or null if there is no match
-// If end is not null set it to the match end
+// If end is not null set it to the match end. Text is read up to its NUL byte
+// as far as the match needs, without taking its length first.
 TRE_DEF const char *tre_match(const tre_comp *tregex, const char *text, const char **end);
 
-// Same but compiles pattern then matches
+// Same with text of length tlen
+TRE_DEF const char *tre_nmatch(const tre_comp *tregex, const char *text, size_t tlen, const char **end);
+
+// Same with caller-provided scratch memory mem of size bytes, reusable across calls.
+// Patterns like 'a.*b', which are backtracked first, memoize the backtracker in it
+// where (number of nodes) x (tlen + 1) bits fit in it and in TRE_BITSTATE_BITS, in
+// O(nodes x tlen) steps. The Shift-And engine uses it as lazy DFA cache.
+TRE_DEF const char *tre_nmatch_mem(const tre_comp *tregex, const char *text, size_t tlen, const char **end,
+                                   void *mem, size_t size);
+
+// Bytes of scratch memory tre_nmatch_mem, tre_nmatch_scratch and tre_nmatch_safe use at
+// most for tregex on texts of up to tlen bytes: the lazy DFA cache, or the bit per node
+// and text byte of tre_nmatch_safe if more. The largest over the patterns sizes a
+// thread's scratch.
+TRE_DEF size_t tre_scratch_size(const tre_comp *tregex, size_t tlen);
+
+// Set up scratch over mem of size bytes
+TRE_DEF void tre_scratch_init(tre_scratch *scratch, void *mem, size_t size);
+
+// Same as tre_nmatch_mem with the memory of scratch, which may be null
+TRE_DEF const char *tre_nmatch_scratch(const tre_comp *tregex, const char *text, size_t tlen, const char **end,
+                                       tre_scratch *scratch);
+
+// Same starting in the backtracker, which is quick on most patterns and texts. Once it
+// takes more than TRE_SAFE_STEPS steps per text byte the search starts over in the
+// Shift-And engine, linear in tlen for every pattern, and scratch->nfallback is
+// counted up. Same match either way. On short texts, where scratch has room for a bit
+// per node and text byte, the backtracker tries each node at each byte once at most.
+TRE_DEF const char *tre_nmatch_safe(const tre_comp *tregex, const char *text, size_t tlen, const char **end,
+                                    tre_scratch *scratch);
+
+// Same as tre_nmatch with TRE_PADDING readable bytes of any value past text + tlen,
+// which the SSE2 engine of fixed-width patterns loads from instead of stepping through
+// the last bytes one by one. Other patterns are matched as by tre_nmatch.
+TRE_DEF const char *tre_nmatch_padded(const tre_comp *tregex, const char *text, size_t tlen, const char **end);
+
+// Does tregex match the empty string, as it would an empty text
+TRE_DEF int tre_nullable(const tre_comp *tregex);
+
+// Set up ctx to search tregex in text of length tlen, with caller memory mem of
+// size bytes as in tre_nmatch_mem. ctx and mem are in use until the search is done.
+TRE_DEF void tre_ctx_init(tre_ctx *ctx, const tre_comp *tregex, const char *text, size_t tlen,
+                          void *mem, size_t size);
+
+// Go on with the search of ctx for at most budget more text bytes. Returns TRE_AGAIN
+// until it is done, then 1 with the match in ctx->start and ctx->end, or 0.
+TRE_DEF int tre_ctx_run(tre_ctx *ctx, size_t budget);
+
+// Build the DFA of tregex in buf of size bytes, 4-byte aligned, and return its size.
+// Up to nclass + 1 bytes per state may be used before equivalent states are merged, at most
+// TRE_DFA_BUILDSIZE. Returns 0 for patterns needing the backtracker or counters, mixing
+// greedy and lazy quantifiers, or with scans of more than TRE_MAX_DFASTATES states.
+TRE_DEF size_t tre_dfa_build(const tre_comp *tregex, void *buf, size_t size);
+
+// Check a DFA of size bytes read back into buf, 4-byte aligned, before matching with it.
+// Returns it, or null if it is not one tre_dfa_build could have made.
+TRE_DEF const tre_dfa *tre_dfa_load(const void *buf, size_t size);
+
+// Same as tre_nmatch with the DFA of a pattern, one table lookup per text byte
+TRE_DEF const char *tre_dfa_nmatch(const tre_dfa *dfa, const char *text, size_t tlen, const char **end);
+
+// Empty set to add patterns to
+TRE_DEF void tre_set_init(tre_set *set);
+
+// Add tregex as pattern set->n of set. Returns 0 if it has no room left for it, or
+// if tregex needs the backtracker or counters. A set holds up to TRE_MAX_SET patterns
+// in TRE_SET_WORDS words, a bit per position and one more per pattern, so fewer if
+// they are long. More patterns are split over several sets, each matched in a pass
+// of its own, and once one refuses a pattern the next set takes it.
+TRE_DEF int tre_set_add(tre_set *set, const tre_comp *tregex);
+
+// Match all patterns of set in text of length tlen in a single pass. Returns the
+// patterns matching somewhere in text, pattern i as bit i.
+TRE_DEF uint64_t tre_set_nmatch(const tre_set *set, const char *text, size_t tlen);
+
+// Empty lexer to add rules to
+TRE_DEF void tre_lexer_init(tre_lexer *lex);
+
+// Add tregex as rule lex->set.n of lex, with the same limits as tre_set_add
+TRE_DEF int tre_lexer_add(tre_lexer *lex, const tre_comp *tregex);
+
+// Longest token at the start of text of length tlen. Returns the rule matching it,
+// the one added first of those matching as many bytes, and sets end to its end.
+// Returns -1 if no rule takes a byte. Every rule is anchored at the token start,
+// '$' rules at the end of text as well.
+TRE_DEF int tre_lex(const tre_lexer *lex, const char *text, size_t tlen, const char **end);
+
+// Same as tre_nmatch allowing up to k inserted, deleted or substituted bytes.
+// Returns the leftmost of the earliest ending matches with the fewest errors and sets
+// dist, if not null, to their number. Needs a Shift-And pattern without counters.
+TRE_DEF const char *tre_nmatch_fuzzy(const tre_comp *tregex, const char *text, size_t tlen, unsigned k,
+                                     const char **end, unsigned *dist);
+
+// Same as tre_match but compiles pattern then matches
 TRE_DEF const char *tre_compile_match(const char *pattern, const char *text, const char **end);
 
 // Print the pattern
@@ -90,8 +338,23 @@ TRE_DEF void tre_print(const tre_comp *tregex);
 
 #ifdef TRE_IMPLEMENTATION
 
-#define TRE_MAXQUANT  1024  // Max b in {a,b}. must be < ushrt_max
-#define TRE_MAXPLUS  40000  // For + and *,  > 32768 for test2
+#define TRE_MAXPLUS ((size_t)-1) // For + and *, unbounded
+#define TRE_QUANTINF 0xFFFF // mn[1] of {a,}, unbounded as well
+#ifndef TRE_LITSLACK
+#define TRE_LITSLACK    256 // Bytes matchliteral may scan beyond 4 per text byte
+#endif
+#ifndef TRE_SETSCAN
+#define TRE_SETSCAN     256 // Min bytes a backtracker scan tabulates its node for
+#endif
+#ifndef TRE_SAFE_STEPS
+#define TRE_SAFE_STEPS    8 // Backtracking steps per text byte before tre_nmatch_safe falls back
+#endif
+#ifndef TRE_JUMP_STEPS
+#define TRE_JUMP_STEPS    4 // Backtracking steps per text byte before a jump pattern is scanned instead
+#endif
+#ifndef TRE_BITSTATE_BITS
+#define TRE_BITSTATE_BITS (256 * 1024) // Max size of the visited bitset, see tre_nmatch_mem
+#endif
 
 #define TRE_TYPES_X  X(NONE) X(BEGIN) X(END) \
         X(QUANT) X(LQUANT) X(QMARK) X(LQMARK) X(STAR) X(LSTAR) X(PLUS) X(LPLUS) \
@@ -128,58 +391,226 @@ TRE_DEF const char *tre_compile_match(const char *pattern, const char *text, con
     return tre_match(&tregex, text, end);
 }
 
-static const char *matchpattern(const tre_node *nodes, const char *text, const char *tend);
+// Is p before the end of text, which is the NUL byte if tend is null
+#define TRE_BEFORE(p, tend) ((tend) ? (p) < (tend) : *(p) != 0)
 
-TRE_DEF const char *tre_nmatch(const tre_comp *tregex, const char *text, unsigned tlen, const char **end)
+// Backtracking state
+typedef struct
 {
-    if (!tregex || !text || !tlen)
+    const char *tend;       // end of text, or null for the NUL byte
+    const tre_node *nodes;  // first node and
+    const char *text;       // first position of visited
+    size_t width;           // positions per node in visited
+    unsigned char *visited; // bitset of explored (node, position) or null
+    size_t steps, limit;    // calls and bytes scanned so far, and how many may be
+} tre_bt;
+
+static const char *matchpattern(const tre_node *nodes, const char *text, tre_bt *bt);
+static int plainchar(const tre_node *n);
+static int takesbyte(const tre_node *n);
+static const char *matchbits(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                             void *mem, size_t size);
+static void bitcompile(tre_comp *tregex, const unsigned char *freq);
+static void onepasscompile(tre_comp *tregex);
+static const char *matchonepass(const tre_comp *tregex, const char *text, const char *tend, const char **end);
+static const char *matchliteral(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                                void *mem, size_t size);
+static void fixcompile(tre_comp *tregex);
+static const char *matchfixed(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                              int padded);
+static void spancompile(tre_comp *tregex);
+static const char *matchspan(const tre_comp *tregex, const char *text, const char *tend, const char **end);
+static void jumpcompile(tre_comp *tregex);
+static int matchjump(const tre_comp *tregex, const char *text, const char *tend, const char **start,
+                     const char **end, void *mem, size_t size);
+
+// Pattern properties in tre_comp.flags
+#define TRE_F_BITS   1  // fwd and rev are usable
+#define TRE_F_BEGIN  2  // anchored at start
+#define TRE_F_END    4  // anchored at end
+#define TRE_F_NULL   8  // can match the empty string
+#define TRE_F_GREEDY 16 // has a greedy quantifier of variable count
+#define TRE_F_LAZY   32 // has a lazy quantifier of variable count
+#define TRE_F_ONEPASS 64 // anchored at start and unambiguous, see onepasscompile
+#define TRE_F_LIT   128 // has a literal for matchliteral
+#define TRE_F_FIXED 256 // fixed width with ranges, see fixcompile
+#define TRE_F_SPAN  512 // one node with a quantifier, see spancompile
+#define TRE_F_JUMP 1024 // backtracked first, see jumpcompile
+
+// Set up bt for matching nodes in text, with mem as visited bitset if it fits
+static void btinit(tre_bt *bt, const tre_node *nodes, const char *text, const char *tend, void *mem, size_t size)
+{
+    size_t n = 1, bits;
+    while (nodes[n - 1].type != TRE_NONE) { n++; }
+
+    bt->tend = tend;
+    bt->nodes = nodes;
+    bt->text = text;
+    bt->width = tend ? (size_t)(tend - text) + 1 : 0;
+    bt->visited = 0;
+    bt->steps = 0;
+    bt->limit = (size_t)-1;
+
+    bits = n * bt->width;
+    if (mem && tend && bits / n == bt->width && bits <= TRE_BITSTATE_BITS && bits / 8 < size)
     {
-        tre_err("NULL text or tre_comp");
-        return 0;
+        bt->visited = (unsigned char *)mem;
+        memset(mem, 0, bits / 8 + 1);
     }
+}
 
-    const char *tend = text + tlen;
+// Leftmost match from text on, null as well once bt has taken more than its limit of steps
+static const char *backtrack(const tre_comp *tregex, const char *text, tre_bt *bt, const char **end)
+{
+    const tre_node *n = bt->nodes;
+    const int skip = bt->tend && !(tregex->flags & TRE_F_BEGIN) && plainchar(n) && takesbyte(n);
     const char *mend;
-    const tre_node *nodes = tregex->nodes;
 
-    if (nodes->type == TRE_BEGIN)
+    for (;; text++)
     {
-        mend = matchpattern(nodes + 1, text, tend);
+        // Only the bytes a plain first node takes can start a match
+        if (skip && !(text = (const char *)memchr(text, n->ch, (size_t)(bt->tend - text))))
+            return 0;
+        mend = matchpattern(n, text, bt);
         if (mend)
         {
+            //if (!*text) //Fixme: ???
+            //    return 0;
             if (end) { *end = mend; }
             return text;
         }
+        if ((tregex->flags & TRE_F_BEGIN) || !TRE_BEFORE(text, bt->tend) || bt->steps > bt->limit)
+            break;
+    }
+
+    return 0;
+}
+
+static const char *matchbacktrack(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                                  void *mem, size_t size)
+{
+    tre_bt bt;
+    btinit(&bt, tregex->nodes + ((tregex->flags & TRE_F_BEGIN) ? 1 : 0), text, tend, mem, size);
+    return backtrack(tregex, text, &bt, end);
+}
+
+// Match in text up to tend, or up to the NUL byte if tend is null
+static const char *matchtext(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                             void *mem, size_t size)
+{
+    const char *start;
+
+    if (tregex->flags & TRE_F_ONEPASS)
+        return matchonepass(tregex, text, tend, end);
+    if (tregex->flags & TRE_F_FIXED)
+        return matchfixed(tregex, text, tend, end, 0);
+    if ((tregex->flags & TRE_F_JUMP) && tend && matchjump(tregex, text, tend, &start, end, mem, size))
+        return start;
+    if (tregex->flags & TRE_F_LIT)
+        return matchliteral(tregex, text, tend, end, mem, size);
+    if (tregex->flags & TRE_F_SPAN)
+        return matchspan(tregex, text, tend, end);
+    if (tregex->flags & TRE_F_BITS)
+        return matchbits(tregex, text, tend, end, mem, size);
+    return matchbacktrack(tregex, text, tend, end, mem, size);
+}
+
+TRE_DEF const char *tre_nmatch_mem(const tre_comp *tregex, const char *text, size_t tlen, const char **end,
+                                   void *mem, size_t size)
+{
+    if (!tregex || !text || !tlen)
+    {
+        tre_err("NULL text or tre_comp");
         return 0;
     }
 
-    do
+    return matchtext(tregex, text, text + tlen, end, mem, size);
+}
+
+TRE_DEF const char *tre_nmatch(const tre_comp *tregex, const char *text, size_t tlen, const char **end)
+{
+    return tre_nmatch_mem(tregex, text, tlen, end, 0, 0);
+}
+
+TRE_DEF const char *tre_nmatch_padded(const tre_comp *tregex, const char *text, size_t tlen, const char **end)
+{
+    if (!tregex || !text || !tlen)
     {
-        mend = matchpattern(nodes, text, tend);
-        if (mend)
-        {
-            //if (!*text) //Fixme: ???
-            //    return 0;
-            if (end) { *end = mend; }
-            return text;
-        }
+        tre_err("NULL text or tre_comp");
+        return 0;
     }
-    while (tend > text++);
 
-    return 0;
+    if (tregex->flags & TRE_F_FIXED)
+        return matchfixed(tregex, text, text + tlen, end, 1);
+    return matchtext(tregex, text, text + tlen, end, 0, 0);
+}
+
+TRE_DEF int tre_nullable(const tre_comp *tregex)
+{
+    const tre_node *nodes = tregex->nodes + ((tregex->flags & TRE_F_BEGIN) ? 1 : 0);
+    const char *empty = "";
+    tre_bt bt;
+
+    btinit(&bt, nodes, empty, empty, 0, 0);
+    return matchpattern(nodes, empty, &bt) != 0;
 }
 
 TRE_DEF const char *tre_match(const tre_comp *tregex, const char *text, const char **end)
 {
-    return tre_nmatch(tregex, text, strlen(text), end);
+    if (!tregex || !text || !*text)
+    {
+        tre_err("NULL text or tre_comp");
+        return 0;
+    }
+
+    return matchtext(tregex, text, 0, end, 0, 0);
 }
 
 #define TRE_ISMETA(c) ((c=='s')||(c=='S')||(c=='w')||(c=='W')||(c=='d')||(c=='D'))
 // s,S,w,W,d,D or esc
 #define TRE_METAORESC(c) (TRE_ISMETA(c)||(c=='\\'))
 
+// Byte frequencies in text, source code and logs, higher for more common bytes
+static const unsigned char tre_freq[256] =
+{
+     29,  28,  27,  26,  25,  24,  23,  22,  21, 198, 240,  20,  19, 179,  18,  17,
+     16,  15,  14,  13,  12,  11,  10,   9,   8,   7,   6,   5,   4,   3,   2,   1,
+    255, 171, 223, 180, 170, 169, 173, 195, 222, 221, 187, 172, 233, 226, 232, 220,
+    229, 228, 227, 210, 208, 209, 205, 204, 206, 207, 219, 196, 181, 224, 182, 168,
+    161, 216, 194, 213, 201, 214, 193, 189, 192, 215, 165, 176, 202, 200, 211, 203,
+    199, 163, 212, 217, 218, 188, 177, 191, 164, 175, 162, 184, 166, 183, 158, 225,
+    160, 252, 234, 243, 244, 254, 239, 237, 246, 250, 190, 230, 245, 241, 249, 251,
+    238, 178, 247, 248, 253, 242, 231, 236, 197, 235, 174, 186, 167, 185, 159,   0,
+    157, 156, 155, 154, 153, 152, 151, 150, 149, 148, 147, 146, 145, 144, 143, 142,
+    141, 140, 139, 138, 137, 136, 135, 134, 133, 132, 131, 130, 129, 128, 127, 126,
+    125, 124, 123, 122, 121, 120, 119, 118, 117, 116, 115, 114, 113, 112, 111, 110,
+    109, 108, 107, 106, 105, 104, 103, 102, 101, 100,  99,  98,  97,  96,  95,  94,
+     93,  92,  91,  90,  89,  88,  87,  86,  85,  84,  83,  82,  81,  80,  79,  78,
+     77,  76,  75,  74,  73,  72,  71,  70,  69,  68,  67,  66,  65,  64,  63,  62,
+     61,  60,  59,  58,  57,  56,  55,  54,  53,  52,  51,  50,  49,  48,  47,  46,
+     45,  44,  43,  42,  41,  40,  39,  38,  37,  36,  35,  34,  33,  32,  31,  30,
+};
+
+TRE_DEF void tre_train_freq(const char *sample, size_t len, unsigned char *freq)
+{
+    size_t count[256] = { 0 }, max = 1, i;
+
+    for (i = 0; i < len; i++)
+        count[(unsigned char)sample[i]]++;
+    for (i = 0; i < 256; i++)
+        if (count[i] > max) { max = count[i]; }
+    // Seen bytes stay above unseen ones
+    for (i = 0; i < 256; i++)
+        freq[i] = count[i] ? (unsigned char)(1 + count[i] * 254 / max) : 0;
+}
+
+TRE_DEF int tre_ncompile(const char *pattern, size_t plen, tre_comp *tregex)
+{
+    return tre_ncompile_freq(pattern, plen, 0, tregex);
+}
+
 //#define REQUIRE_SPACE(X, S) if(idx > TRE_MAX_BUFLEN - (X)) {return tre_err(S);}
-TRE_DEF int tre_ncompile(const char *pattern, unsigned plen, tre_comp *tregex)
+TRE_DEF int tre_ncompile_freq(const char *pattern, size_t plen, const unsigned char *freq, tre_comp *tregex)
 {
     if (!tregex || !pattern || !plen)
         return tre_err("NULL/empty string or tre_comp");
@@ -288,7 +719,7 @@ TRE_DEF int tre_ncompile(const char *pattern, unsigned plen, tre_comp *tregex)
                     continue;
 
                 rmax = rmax ? pattern[i + 3] : pattern[i + 2];
-                if (rmax < pattern[i])
+                if (rmax < (unsigned char)pattern[i])
                     return tre_err("Incorrect range in class");
                 if (idx > TRE_MAX_BUFLEN - 2)
                     return tre_err("Buffer overflow at range - in class");
@@ -331,7 +762,7 @@ TRE_DEF int tre_ncompile(const char *pattern, unsigned plen, tre_comp *tregex)
                     return tre_err("Unexpected end of string in quantifier");
                 if (pattern[i] == '}')
                 {
-                    val = TRE_MAXQUANT;
+                    val = TRE_QUANTINF;
                 }
                 else
                 {
@@ -357,9 +788,16 @@ TRE_DEF int tre_ncompile(const char *pattern, unsigned plen, tre_comp *tregex)
         i++;
         j++;
     }
+    if (i < plen)
+        return tre_err("Too many nodes in pattern");
     // 'TRE_NONE' is a sentinel used to indicate end-of-pattern
     tnode[j].type = TRE_NONE;
 
+    bitcompile(tregex, freq ? freq : tre_freq);
+    onepasscompile(tregex);
+    fixcompile(tregex);
+    spancompile(tregex);
+    jumpcompile(tregex);
     return 1;
 }
 
@@ -390,6 +828,7 @@ static int matchmetachar(char c, char mc)
 // note: compiler makes sure that it is always esc + nonzero (sSwWdD\)
 static int matchcharclass(char c, const unsigned char *str)
 {
+    const unsigned char u = (unsigned char)c; // as str holds them, high bytes included
     unsigned char rmax;
     while (*str != '\0')
     {
@@ -402,7 +841,7 @@ static int matchcharclass(char c, const unsigned char *str)
         }
         else
         {
-            if (c == *str) { return 1; }
+            if (u == *str) { return 1; }
             str += 1;
         }
 
@@ -413,7 +852,7 @@ static int matchcharclass(char c, const unsigned char *str)
             continue;
 
         rmax = rmax ? str[2] : str[1];
-        if (c >= str[-1] && c <= rmax) { return 1; }
+        if (u >= str[-1] && u <= rmax) { return 1; }
         str++;
 
     }
@@ -432,7 +871,7 @@ static int matchone(const tre_node *tnode, char c)
 {
     switch (tnode->type)
     {
-    case TRE_CHAR:   return (tnode->ch == c);
+    case TRE_CHAR:   return (tnode->ch == (unsigned char)c);
     case TRE_DOT:    return  TRE_MATCHDOT(c);
     case TRE_CLASS:  return  matchcharclass(c, tnode->ccl);
     case TRE_NCLASS: return !matchcharclass(c, tnode->ccl);
@@ -452,43 +891,273 @@ static int matchone(const tre_node *tnode, char c)
 #undef TRE_MATCHALNUM
 #undef TRE_MATCHDOT
 
-static const char *matchquant_lazy(const tre_node *nodes, const char *text, const char *tend,
-                                   unsigned min, unsigned max)
+// Get min and max count of quantifier node q, return 0 if q is none
+static int quantof(const tre_node *q, size_t *min, size_t *max)
+{
+    switch (q->type)
+    {
+    case TRE_QMARK: case TRE_LQMARK: *min = 0; *max = 1; break;
+    case TRE_STAR:  case TRE_LSTAR:  *min = 0; *max = TRE_MAXPLUS; break;
+    case TRE_PLUS:  case TRE_LPLUS:  *min = 1; *max = TRE_MAXPLUS; break;
+    case TRE_QUANT: case TRE_LQUANT:
+        *min = q->mn[0];
+        *max = (q->mn[1] == TRE_QUANTINF) ? TRE_MAXPLUS : q->mn[1];
+        break;
+    default: *min = *max = 1; return 0;
+    }
+    return 1;
+}
+
+// Is node n a character memchr can look for
+static int plainchar(const tre_node *n)
+{
+    return n->type == TRE_CHAR;
+}
+
+// Does node n with its quantifier have to take a byte
+static int takesbyte(const tre_node *n)
+{
+    size_t min, max;
+    if (n->type == TRE_NONE || (n->type == TRE_END && n[1].type == TRE_NONE))
+        return 0;
+    quantof(n + 1, &min, &max);
+    return min > 0;
+}
+
+// memrchr is a GNU extension
+static const void *tre_memrchr(const void *s, int c, size_t n)
+{
+#if defined(__GLIBC__) && defined(_GNU_SOURCE)
+    return memrchr(s, c, n);
+#else
+    const uint64_t ones = 0x0101010101010101ull, x = ones * (unsigned char)c;
+    const unsigned char *p = (const unsigned char *)s + n;
+    uint64_t w;
+
+    // Eight bytes at a time up to a word holding c, then byte by byte
+    for (; n >= 8; p -= 8, n -= 8)
+    {
+        memcpy(&w, p - 8, 8);
+        w ^= x;
+        if ((w - ones) & ~w & (ones << 7))
+            break;
+    }
+    while (n--)
+    {
+        if (*--p == (unsigned char)c)
+            return p;
+    }
+    return 0;
+#endif
+}
+
+// strnlen is POSIX
+static size_t tre_strnlen(const char *s, size_t n)
+{
+#if defined(__GLIBC__) && (defined(_GNU_SOURCE) || _POSIX_C_SOURCE >= 200809L)
+    return strnlen(s, n);
+#else
+    const char *p = s;
+    while (n-- && *p) { p++; }
+    return (size_t)(p - s);
+#endif
+}
+
+// Bytes taken by node n, for scans of TRE_SETSCAN bytes or more
+static void byteset(const tre_node *n, unsigned char *set)
+{
+    unsigned c;
+    for (c = 0; c < 256; c++)
+        set[c] = matchone(n, (char)c);
+}
+
+// Last byte in [p, e) taken by node n, or null
+static const char *lastbyte(const tre_node *n, const char *p, const char *e)
+{
+    unsigned char set[256];
+    if (p >= e)
+        return 0;
+    if (plainchar(n))
+        return (const char *)tre_memrchr(p, n->ch, e - p);
+    if (e - p >= TRE_SETSCAN)
+    {
+        byteset(n, set);
+        while (e > p)
+        {
+            if (set[(unsigned char)*--e])
+                return e;
+        }
+        return 0;
+    }
+    while (e > p)
+    {
+        if (matchone(n, *--e))
+            return e;
+    }
+    return 0;
+}
+
+// First byte taken by node n in the max bytes from p before tend, or null
+static const char *nextbyte(const tre_node *n, const char *p, const char *tend, size_t max)
+{
+    unsigned char set[256];
+    const char *e;
+    if (!tend)
+    {
+        // Up to the NUL byte, which is not taken
+        if (max >= TRE_SETSCAN)
+        {
+            byteset(n, set);
+            for (; max && *p; p++, max--)
+            {
+                if (set[(unsigned char)*p])
+                    return p;
+            }
+            return 0;
+        }
+        for (; max && *p; p++, max--)
+        {
+            if (matchone(n, *p))
+                return p;
+        }
+        return 0;
+    }
+    e = ((size_t)(tend - p) > max) ? p + max : tend;
+    if (plainchar(n))
+        return (p < e) ? (const char *)memchr(p, n->ch, e - p) : 0;
+    if (e - p >= TRE_SETSCAN)
+    {
+        byteset(n, set);
+        for (; p < e; p++)
+        {
+            if (set[(unsigned char)*p])
+                return p;
+        }
+        return 0;
+    }
+    for (; p < e; p++)
+    {
+        if (matchone(n, *p))
+            return p;
+    }
+    return 0;
+}
+
+// First byte not taken by node n in the max bytes from p before tend, or the byte after them
+static const char *matchrun(const tre_node *n, const char *p, const char *tend, size_t max)
+{
+    unsigned char set[256];
+    const char *q, *e;
+    if (!tend)
+    {
+        // Up to the NUL byte, which is not taken
+        if (max >= TRE_SETSCAN)
+        {
+            byteset(n, set);
+            set[0] = 0;
+            while (max && set[(unsigned char)*p]) { p++; max--; }
+            return p;
+        }
+        while (max && *p && matchone(n, *p)) { p++; max--; }
+        return p;
+    }
+    e = ((size_t)(tend - p) > max) ? p + max : tend;
+    if (n->type == TRE_DOT)
+    {
+#ifndef TRE_DOTANY
+        if (p < e && (q = (const char *)memchr(p, '\n', e - p))) { e = q; }
+        if (p < e && (q = (const char *)memchr(p, '\r', e - p))) { e = q; }
+#else
+        (void) q;
+#endif
+        return e;
+    }
+    if (e - p >= TRE_SETSCAN)
+    {
+        byteset(n, set);
+        while (p < e && set[(unsigned char)*p]) { p++; }
+        return p;
+    }
+    while (p < e && matchone(n, *p)) { p++; }
+    return p;
+}
+
+static const char *matchquant_lazy(const tre_node *nodes, const char *text, tre_bt *bt,
+                                   size_t min, size_t max)
 {
-    const char *end;
-    max = max - min + 1;
-    while (min && text < tend && matchone(nodes, *text)) { text++; min--; }
+    const char *end, *tend = bt->tend, *next;
+    const int jump = takesbyte(nodes + 2);
+    if (max != TRE_MAXPLUS)
+        max = max - min + 1;
+    while (min && TRE_BEFORE(text, tend) && matchone(nodes, *text)) { text++; min--; }
     if (min) { return 0; }
 
     do
     {
-        end = matchpattern(nodes + 2, text, tend);
-        if (end) { return end; }
+        // Ahead to the first byte the next node takes, if this one takes all before it
+        if (jump)
+        {
+            next = nextbyte(nodes + 2, text, tend, max);
+            if (!next)
+            {
+                // The bytes looked at in vain count as well
+                bt->steps += !tend ? 0 : ((size_t)(tend - text) < max) ? (size_t)(tend - text) : max;
+                return 0;
+            }
+            bt->steps += next - text;
+            if (matchrun(nodes, text, next, max) != next)
+                return 0;
+            max -= next - text;
+            text = next;
+        }
+        end = matchpattern(nodes + 2, text, bt);
+        if (end || bt->steps > bt->limit) { return end; }
         max--;
     }
-    while (max && text < tend && matchone(nodes, *text++));
+    while (max && TRE_BEFORE(text, tend) && matchone(nodes, *text++));
 
     return 0;
 }
 
-static const char *matchquant(const tre_node *nodes, const char *text, const char *tend,
-                              unsigned min, unsigned max)
+static const char *matchquant(const tre_node *nodes, const char *text, tre_bt *bt,
+                              size_t min, size_t max)
 {
-    const char *end, *start = text;
-    while (max && text < tend && matchone(nodes, *text)) { text++; max--; }
+    const char *end, *start = text, *tend = bt->tend;
+    const int jump = takesbyte(nodes + 2);
+    text = matchrun(nodes, text, tend, max);
+    bt->steps += text - start;
+    if ((size_t)(text - start) < min)
+        return 0;
 
-    while (text - start >= (int)min)
+    for (;; text--)
     {
-        end = matchpattern(nodes + 2, text--, tend);
-        if (end) { return end; }
+        // Back to the last byte the next node takes
+        if (jump && !(text = lastbyte(nodes + 2, start + min, TRE_BEFORE(text, tend) ? text + 1 : text)))
+            return 0;
+        end = matchpattern(nodes + 2, text, bt);
+        if (end || bt->steps > bt->limit) { return end; }
+        if ((size_t)(text - start) == min)
+            return 0;
     }
-
-    return 0;
 }
 
 // Iterative matching
-static const char *matchpattern(const tre_node *nodes, const char *text, const char *tend)
+static const char *matchpattern(const tre_node *nodes, const char *text, tre_bt *bt)
 {
+    const char *tend = bt->tend;
+    size_t i, min, max;
+
+    if (++bt->steps > bt->limit)
+        return 0; // given up, see tre_nmatch_safe
+    if (bt->visited && nodes[0].type != TRE_NONE)
+    {
+        // Explored before without success, a success ends the search
+        i = (size_t)(nodes - bt->nodes) * bt->width + (size_t)(text - bt->text);
+        if (bt->visited[i >> 3] & (1 << (i & 7)))
+            return 0;
+        bt->visited[i >> 3] |= 1 << (i & 7);
+    }
+
     do
     {
         if (nodes[0].type == TRE_NONE)
@@ -497,71 +1166,1970 @@ static const char *matchpattern(const tre_node *nodes, const char *text, const c
         }
         if ((nodes[0].type == TRE_END) && nodes[1].type == TRE_NONE)
         {
-            return (text == tend) ? text : 0;
+            return TRE_BEFORE(text, tend) ? 0 : text;
         }
 
         switch (nodes[1].type)
         {
-        case TRE_QMARK:
-            return matchquant(nodes, text, tend, 0, 1);
-        case TRE_LQMARK:
-            return matchquant_lazy(nodes, text, tend, 0, 1);
-        case TRE_QUANT:
-            return matchquant(nodes, text, tend, nodes[1].mn[0], nodes[1].mn[1]);
-        case TRE_LQUANT:
-            return matchquant_lazy(nodes, text, tend, nodes[1].mn[0], nodes[1].mn[1]);
-        case TRE_STAR:
-            return matchquant(nodes, text, tend, 0, TRE_MAXPLUS);
-        case TRE_LSTAR:
-            return matchquant_lazy(nodes, text, tend, 0, TRE_MAXPLUS);
-        case TRE_PLUS:
-            return matchquant(nodes, text, tend, 1, TRE_MAXPLUS);
-        case TRE_LPLUS:
-            return matchquant_lazy(nodes, text, tend, 1, TRE_MAXPLUS);
+        case TRE_QMARK: case TRE_QUANT: case TRE_STAR: case TRE_PLUS:
+            quantof(nodes + 1, &min, &max);
+            return matchquant(nodes, text, bt, min, max);
+        case TRE_LQMARK: case TRE_LQUANT: case TRE_LSTAR: case TRE_LPLUS:
+            quantof(nodes + 1, &min, &max);
+            return matchquant_lazy(nodes, text, bt, min, max);
             // default: break; // w/e
         }
     }
-    while (text < tend && matchone(nodes++, *text++));
+    while (TRE_BEFORE(text, tend) && matchone(nodes++, *text++));
 
     return 0;
 }
 
-void tre_print(const tre_comp *tregex)
+// Bit-parallel Shift-And engine
+// ------------------------------
+// Every node is expanded into positions, one bit each: 'a{2,3}' gives 'a a a?',
+// '*' and '+' give a single repeating position. If that needs more than 64
+// positions, each node of more than one becomes a single position with a
+// counter instead, which leaves at most 63. fwd reads the positions from left
+// to right and rev from right to left. A match is found in three scans:
+//   1. scan fwd from every start for the earliest match end
+//   2. scan rev back from there for the leftmost start
+//   3. pick the end matchpattern would pick from that start, which is the
+//      earliest end without greedy and the longest without lazy quantifiers;
+//      mixed patterns pick the count of each node in turn, see bitend
+
+// Number of expanded positions for count min to max
+static unsigned bitcount(size_t min, size_t max)
 {
-#ifdef TRE_SILENT
-    (void) tregex;
-#else
-#define X(A) #A,
-    static const char *tre_typenames[] = { TRE_TYPES_X };
-#undef X
+    if (max != TRE_MAXPLUS)
+        return (unsigned)max;
+    return min > 1 ? (unsigned)min : 1;
+}
 
-    if (!tregex)
+// Number of expanded positions of the nodes from n, none counted
+static unsigned bittotal(const tre_node *n)
+{
+    size_t min, max;
+    unsigned total = 0;
+
+    for (; n->type != TRE_NONE && !(n->type == TRE_END && n[1].type == TRE_NONE); n++)
     {
-        printf("NULL compiled regex detected\n");
-        return;
+        n += quantof(n + 1, &min, &max);
+        total += bitcount(min, max);
     }
+    return total;
+}
 
-    const tre_node *tnode = tregex->nodes;
-    int i;
-    for (i = 0; i < TRE_MAX_NODES; ++i)
+// Number of positions of a node of count min to max in a pattern of total expanded ones
+static unsigned bitwidth(unsigned total, size_t min, size_t max)
+{
+    const unsigned cnt = bitcount(min, max);
+    return (total > 64 && cnt > 1) ? 1 : cnt;
+}
+
+static uint64_t bitrev(uint64_t x, unsigned n)
+{
+    uint64_t r = 0;
+    while (n--) { r = (r << 1) | (x & 1); x >>= 1; }
+    return r;
+}
+
+static void bitcompile(tre_comp *tregex, const unsigned char *freq)
+{
+    const tre_node *n = tregex->nodes;
+    tre_bits *f = &tregex->fwd, *r = &tregex->rev;
+    unsigned char set[256];
+    size_t min, max;
+    unsigned cnt, i, c, p = 0, total;
+    unsigned runpos = 0, runlen = 0, runrare = 0, litpos = 0, litlen = 0, litrare = 0;
+    char run[TRE_MAX_LITLEN];
+    int counted;
+    uint64_t bit;
+
+    memset(f, 0, sizeof(*f));
+    memset(r, 0, sizeof(*r));
+    tregex->flags = 0;
+    tregex->npos = 0;
+    tregex->litlen = 0;
+
+    if (n->type == TRE_BEGIN)
     {
-        if (tnode[i].type == TRE_NONE)
+        tregex->flags |= TRE_F_BEGIN;
+        n++;
+    }
+
+    total = bittotal(n);
+
+    // Stray ^ and $ become positions that accept nothing
+    for (; n->type != TRE_NONE; n += 1 + quantof(n + 1, &min, &max))
+    {
+        if (n->type == TRE_END && n[1].type == TRE_NONE)
+        {
+            tregex->flags |= TRE_F_END;
             break;
+        }
 
-        printf("type: %s", tre_typenames[tnode[i].type]);
-        if (tnode[i].type == TRE_CLASS || tnode[i].type == TRE_NCLASS)
+        // Run of plain characters with the rarest byte, the longest of those
+        if (!quantof(n + 1, &min, &max) && plainchar(n))
         {
-            printf(" \"%s\"", tnode[i].ccl);
+            if (!runlen || runpos + runlen != p || runlen == TRE_MAX_LITLEN)
+            {
+                runpos = p;
+                runlen = 0;
+                runrare = 0;
+            }
+            if (runlen && freq[n->ch] < freq[(unsigned char)run[runrare]])
+                runrare = runlen;
+            run[runlen++] = n->ch;
+            if (!litlen || freq[(unsigned char)run[runrare]] < freq[(unsigned char)tregex->lit[litrare]] ||
+                (freq[(unsigned char)run[runrare]] == freq[(unsigned char)tregex->lit[litrare]] && runlen > litlen))
+            {
+                litpos = runpos;
+                litlen = runlen;
+                litrare = runrare;
+                memcpy(tregex->lit, run, runlen);
+            }
         }
-        else if (tnode[i].type == TRE_QUANT || tnode[i].type == TRE_LQUANT)
+
+        if (min < max)
         {
-            printf(" {%d,%d}", tnode[i].mn[0], tnode[i].mn[1]);
+            switch (n[1].type)
+            {
+            case TRE_LQMARK: case TRE_LSTAR: case TRE_LPLUS: case TRE_LQUANT:
+                tregex->flags |= TRE_F_LAZY; break;
+            default:
+                tregex->flags |= TRE_F_GREEDY; break;
+            }
         }
-        else if (tnode[i].type == TRE_CHAR)
+
+        cnt = bitcount(min, max);
+        counted = bitwidth(total, min, max) < cnt;
+        if (counted)
         {
-            printf(" '%c'", tnode[i].ch);
+            if (f->ncnt == TRE_MAX_COUNTERS)
+                return;
+            f->cpos[f->ncnt] = p;
+            f->cmin[f->ncnt] = min;
+            f->cmax[f->ncnt] = (max == TRE_MAXPLUS) ? TRE_QUANTINF : max;
+            f->ncnt++;
+            cnt = 1;
         }
-        printf("\n");
+        if (cnt > 64 - p)
+            return; // too many positions, leave it to matchpattern
+
+        for (c = 0; c < 256; c++)
+            set[c] = matchone(n, (char)c);
+        for (i = 0; i < cnt; i++, p++)
+        {
+            bit = (uint64_t)1 << p;
+            for (c = 0; c < 256; c++)
+                if (set[c]) { f->mask[c] |= bit; }
+            if (i >= min)
+                f->opt |= bit;
+            if (max == TRE_MAXPLUS && i + 1 == cnt && !counted)
+                f->rep |= bit;
+        }
+    }
+
+    for (i = p; i > 0; i--)
+    {
+        f->last |= (uint64_t)1 << (i - 1);
+        if (!(f->opt & ((uint64_t)1 << (i - 1))))
+            break;
+    }
+    for (i = 0; i < p; i++)
+    {
+        r->last |= (uint64_t)1 << (p - 1 - i);
+        if (!(f->opt & ((uint64_t)1 << i)))
+            break;
+    }
+    if (i == p)
+        tregex->flags |= TRE_F_NULL;
+
+    r->opt = bitrev(f->opt, p);
+    r->rep = bitrev(f->rep, p);
+    r->ncnt = f->ncnt;
+    for (i = 0; i < f->ncnt; i++)
+    {
+        r->cpos[i] = p - 1 - f->cpos[i];
+        r->cmin[i] = f->cmin[i];
+        r->cmax[i] = f->cmax[i];
+    }
+    for (c = 0; c < 256; c++)
+        r->mask[c] = bitrev(f->mask[c], p);
+
+    // Bytes of the same mask step every scan alike, so the DFAs go by class
+    tregex->nclass = 0;
+    for (c = 0; c < 256; c++)
+    {
+        for (i = 0; i < c && f->mask[i] != f->mask[c]; i++) {}
+        tregex->byteclass[c] = (unsigned char)((i < c) ? tregex->byteclass[i] : tregex->nclass++);
+    }
+
+    tregex->npos = p;
+    tregex->flags |= TRE_F_BITS;
+    if (litlen && !(tregex->flags & TRE_F_BEGIN))
+    {
+        tregex->litpos = litpos;
+        tregex->litlen = litlen;
+        tregex->litrare = litrare;
+        tregex->flags |= TRE_F_LIT;
+    }
+}
+
+static void cntinit(tre_cnt *cnt, const tre_bits *b)
+{
+    unsigned k;
+    cnt->t = 0;
+    cnt->live = 0;
+    for (k = 0; k < b->ncnt; k++)
+        cnt->k[k].since = cnt->k[k].alive = cnt->k[k].ready = 0;
+}
+
+// Update the counted positions in d, x are the entered positions. A counter
+// sets a bit in its ring for each time its loop was entered. Entries leave
+// once they would count more than max bytes, if there is a max, and all go at
+// a byte the loop does not take, after which since keeps older bits from
+// being read. The counted position is in d while an entry has at least min
+// bytes: the entry reaching min is added at each byte and the one passing max
+// taken off, so a byte costs the same for any count.
+static uint64_t cntstep(const tre_bits *b, tre_cnt *cnt, uint64_t x, uint64_t d, unsigned char c)
+{
+    const size_t t = cnt->t++;
+    const uint64_t m = b->mask[c];
+    uint64_t bit, *ring;
+    unsigned k, min, max;
+    size_t e;
+    int live = 0;
+
+    for (k = 0; k < b->ncnt; k++)
+    {
+        bit = (uint64_t)1 << b->cpos[k];
+        d &= ~bit;
+
+        if (!(m & bit))
+        {
+            cnt->k[k].since = t + 1;
+            cnt->k[k].alive = cnt->k[k].ready = 0;
+            continue;
+        }
+
+        min = b->cmin[k] ? b->cmin[k] : 1;
+        max = b->cmax[k];
+        ring = cnt->k[k].ring;
+
+        // The entry of max bytes ago now counts more than max
+        e = t - max;
+        if (max != TRE_QUANTINF && t >= cnt->k[k].since + max && ((ring[(e & 1023) >> 6] >> (e & 63)) & 1))
+        {
+            cnt->k[k].alive--;
+            cnt->k[k].ready--;
+        }
+        // Into the slot of t - 1024, which was read above if it still had to be
+        if (x & bit)
+        {
+            ring[(t & 1023) >> 6] |= (uint64_t)1 << (t & 63);
+            cnt->k[k].alive++;
+        }
+        else
+            ring[(t & 1023) >> 6] &= ~((uint64_t)1 << (t & 63));
+        e = t + 1 - min;
+        if (t + 1 >= cnt->k[k].since + min && ((ring[(e & 1023) >> 6] >> (e & 63)) & 1))
+            cnt->k[k].ready++;
+
+        live |= cnt->k[k].alive != 0;
+        if (cnt->k[k].ready)
+            d |= bit;
+    }
+    cnt->live = live;
+    return d;
+}
+
+// Positions entered from d, and the first one if e is set
+static uint64_t bitenter(const tre_bits *b, uint64_t d, uint64_t e)
+{
+    uint64_t x = (d << 1) | e;
+    return x | ((b->opt + (x & b->opt)) ^ b->opt);
+}
+
+// Enter the positions following d (and the first one if e is set), skipping
+// optional ones, then keep those and the repeating ones of d accepting c
+static uint64_t bitstep(const tre_bits *b, tre_cnt *cnt, uint64_t d, uint64_t e, unsigned char c)
+{
+    const uint64_t x = bitenter(b, d, e);
+    d = (x | (d & b->rep)) & b->mask[c];
+    return b->ncnt ? cntstep(b, cnt, x, d, c) : d;
+}
+
+// Lazy DFA
+// --------
+// Given caller memory, a scan of a program without counters runs on a DFA
+// whose states are the (d, e) pairs of the Shift-And program, added as they
+// are reached, with transitions filled in by bitstep on first use. The cache
+// is rebuilt for every scan. Once it is full the scan goes on without it, as
+// a pattern with that many states gains little from caching. Transitions are
+// kept per byte class, so a state takes a few bytes more than the d and e of
+// its Shift-And state, and one bitstep fills in a whole class.
+
+#define TRE_DFA_STATES 255 // Max cached states, also marks an unknown transition
+
+typedef struct
+{
+    uint64_t d, e;
+    unsigned char accept, dead;
+    unsigned char next[256]; // by byte class, the first nclass used
+} tre_dstate;
+
+// Scan of a Shift-And program, on the DFA if st is set
+typedef struct
+{
+    const tre_bits *b;
+    uint64_t d, e;  // current state
+    uint64_t enext; // e after a step, 0 if anchored
+    int null;       // TRE_F_NULL
+    tre_cnt cnt;
+    tre_dstate *st;
+    unsigned n, cap, s;
+    size_t stride;  // bytes per state in st
+    const unsigned char *cls; // byteclass
+    size_t steps;   // bytes scanned
+} tre_scan;
+
+static tre_dstate *dstate(const tre_scan *sc, unsigned i)
+{
+    return (tre_dstate *)((unsigned char *)sc->st + i * sc->stride);
+}
+
+// Index of DFA state (d, e), added if new, or TRE_DFA_STATES if the cache is full
+static unsigned dfastate(tre_scan *sc, uint64_t d, uint64_t e)
+{
+    tre_dstate *st;
+    unsigned i;
+
+    for (i = 0; i < sc->n; i++)
+        if (dstate(sc, i)->d == d && dstate(sc, i)->e == e)
+            return i;
+
+    if (sc->n == sc->cap)
+        return TRE_DFA_STATES;
+    st = dstate(sc, sc->n);
+    st->d = d;
+    st->e = e;
+    st->accept = (d & sc->b->last) || (e && sc->null);
+    st->dead = !d && !e;
+    memset(st->next, TRE_DFA_STATES, sc->stride - offsetof(tre_dstate, next));
+    return sc->n++;
+}
+
+// Follow a transition missing from the cache
+static unsigned dfanext(tre_scan *sc, unsigned char c)
+{
+    const tre_dstate *st = dstate(sc, sc->s);
+    const uint64_t d = bitstep(sc->b, &sc->cnt, st->d, st->e, c);
+    const unsigned t = dfastate(sc, d, sc->enext);
+
+    if (t == TRE_DFA_STATES)
+    {
+        sc->st = 0;
+        sc->d = d;
+        sc->e = sc->enext;
+    }
+    else
+        dstate(sc, sc->s)->next[sc->cls[c]] = t;
+    return t;
+}
+
+// Start a scan of b, with mem as DFA cache if there is room for it
+static void scaninit(tre_scan *sc, const tre_comp *tregex, const tre_bits *b, int anchored, void *mem, size_t size)
+{
+    const size_t pad = (0 - (uintptr_t)mem) & 7;
+
+    sc->b = b;
+    sc->d = 0;
+    sc->e = 1;
+    sc->enext = !anchored;
+    sc->null = tregex->flags & TRE_F_NULL;
+    sc->steps = 0;
+    cntinit(&sc->cnt, b);
+
+    sc->st = 0;
+    sc->n = 0;
+    sc->cls = tregex->byteclass;
+    sc->stride = (offsetof(tre_dstate, next) + tregex->nclass + 7) & ~(size_t)7;
+    sc->cap = (size > pad) ? (size - pad) / sc->stride : 0;
+    if (sc->cap > TRE_DFA_STATES)
+        sc->cap = TRE_DFA_STATES;
+    if (b->ncnt || sc->cap < 2)
+        return;
+    sc->st = (tre_dstate *)((unsigned char *)mem + pad);
+    sc->s = dfastate(sc, 0, 1);
+}
+
+static void scanstep(tre_scan *sc, unsigned char c)
+{
+    unsigned t;
+
+    sc->steps++;
+    if (sc->st)
+    {
+        t = dstate(sc, sc->s)->next[sc->cls[c]];
+        sc->s = (t != TRE_DFA_STATES) ? t : dfanext(sc, c);
+        return;
+    }
+    sc->d = bitstep(sc->b, &sc->cnt, sc->d, sc->e, c);
+    sc->e = sc->enext;
+}
+
+static int scanaccept(const tre_scan *sc)
+{
+    if (sc->st)
+        return dstate(sc, sc->s)->accept;
+    return (sc->d & sc->b->last) || (sc->e && sc->null);
+}
+
+static int scandead(const tre_scan *sc)
+{
+    if (sc->st)
+        return dstate(sc, sc->s)->dead;
+    return !sc->d && !sc->e && !sc->cnt.live;
+}
+
+// Without the DFA the scans below keep d and e in locals: through sc they
+// would go to memory at every byte, as a store to them may change a mask.
+
+// Earliest end of a match in text
+static const char *bitfirst(const tre_comp *tregex, tre_scan *sc, const char *text, const char *tend)
+{
+    const tre_bits *b = sc->b;
+    const int end = tregex->flags & TRE_F_END;
+    const char *from = text;
+    uint64_t d = sc->d, e = sc->e;
+
+    if (!sc->st)
+    {
+        while (end || !((d & b->last) || (e && sc->null)))
+        {
+            if (!TRE_BEFORE(text, tend))
+                break;
+            d = bitstep(b, &sc->cnt, d, e, *text++);
+            e = sc->enext;
+            if (!d && !e && !sc->cnt.live)
+                break;
+        }
+        sc->d = d;
+        sc->e = e;
+        sc->steps += (size_t)(text - from);
+        return scanaccept(sc) ? text : 0;
+    }
+
+    if (end)
+    {
+        while (TRE_BEFORE(text, tend))
+        {
+            scanstep(sc, *text++);
+            if (scandead(sc))
+                return 0;
+        }
+        return scanaccept(sc) ? text : 0;
+    }
+
+    for (;;)
+    {
+        if (scanaccept(sc))
+            return text;
+        if (!TRE_BEFORE(text, tend))
+            return 0;
+        scanstep(sc, *text++);
+        if (scandead(sc))
+            return 0;
+    }
+}
+
+// Leftmost start of a match ending at mend
+static const char *bitstart(const tre_comp *tregex, tre_scan *sc, const char *text, const char *mend)
+{
+    const tre_bits *b = sc->b;
+    const int begin = tregex->flags & TRE_F_BEGIN;
+    const char *start = 0, *from = mend;
+    uint64_t d = sc->d, e = sc->e;
+
+    if (!sc->st)
+    {
+        for (;;)
+        {
+            if (((d & b->last) || (e && sc->null)) && (!begin || mend == text))
+                start = mend;
+            if (mend == text)
+                break;
+            d = bitstep(b, &sc->cnt, d, e, *--mend);
+            e = sc->enext;
+            if (!d && !e && !sc->cnt.live)
+                break;
+        }
+        sc->d = d;
+        sc->e = e;
+        sc->steps += (size_t)(from - mend);
+        return start;
+    }
+
+    for (;;)
+    {
+        if (scanaccept(sc) && (!begin || mend == text))
+            start = mend;
+        if (mend == text)
+            return start;
+        scanstep(sc, *--mend);
+        if (scandead(sc))
+            return start;
+    }
+}
+
+// Longest match from start
+static const char *bitlast(tre_scan *sc, const char *start, const char *tend)
+{
+    const tre_bits *b = sc->b;
+    const char *mend = 0, *from = start;
+    uint64_t d = sc->d, e = sc->e;
+
+    if (!sc->st)
+    {
+        for (;;)
+        {
+            if ((d & b->last) || (e && sc->null))
+                mend = start;
+            if (!TRE_BEFORE(start, tend))
+                break;
+            d = bitstep(b, &sc->cnt, d, e, *start++);
+            e = sc->enext;
+            if (!d && !e && !sc->cnt.live)
+                break;
+        }
+        sc->d = d;
+        sc->e = e;
+        sc->steps += (size_t)(start - from);
+        return mend;
+    }
+
+    for (;;)
+    {
+        if (scanaccept(sc))
+            mend = start;
+        if (!TRE_BEFORE(start, tend))
+            return mend;
+        scanstep(sc, *start++);
+        if (scandead(sc))
+            return mend;
+    }
+}
+
+// Has the rev scan sc taken the positions of fwd from pos on, entering pos - 1
+static int bitrest(const tre_comp *tregex, const tre_scan *sc, unsigned pos)
+{
+    const tre_dstate *st = sc->st ? dstate(sc, sc->s) : 0;
+    const uint64_t x = st ? bitenter(sc->b, st->d, st->e) : bitenter(sc->b, sc->d, sc->e);
+    return (x >> (tregex->npos - pos)) & 1;
+}
+
+// Start picking the end of the match from start, of which last is the longest end
+static void pickinit(const tre_comp *tregex, tre_pick *pk, const char *start, const char *last)
+{
+    pk->last = last;
+    pk->p = pk->hi = start;
+    pk->q = pk->pick = 0;
+    pk->node = (tregex->flags & TRE_F_BEGIN) ? 1 : 0;
+    pk->pos = 0;
+    pk->total = bittotal(tregex->nodes + pk->node);
+}
+
+// Go on picking the end in pk for at most budget more bytes, counted down.
+// Returns 1 once pk->p is the end, 0 if the budget ran out first.
+static int bitpick(const tre_comp *tregex, tre_pick *pk, tre_scan *sc, size_t *budget, void *mem, size_t size)
+{
+    const tre_node *n;
+    const char *lim, *hi;
+    size_t min, max;
+    unsigned pos;
+    int lazy;
+
+    for (;;)
+    {
+        n = tregex->nodes + pk->node;
+        if (n->type == TRE_NONE || (n->type == TRE_END && n[1].type == TRE_NONE))
+            return 1;
+        quantof(n + 1, &min, &max);
+        pos = pk->pos + bitwidth(pk->total, min, max);
+        lazy = n[1].type == TRE_LQMARK || n[1].type == TRE_LSTAR || n[1].type == TRE_LPLUS || n[1].type == TRE_LQUANT;
+
+        if (!pk->q)
+        {
+            // The bytes the node can take
+            lim = ((size_t)(pk->last - pk->hi) > *budget) ? pk->hi + *budget : pk->last;
+            hi = matchrun(n, pk->hi, lim, max - (size_t)(pk->hi - pk->p));
+            *budget -= (size_t)(hi - pk->hi);
+            pk->hi = hi;
+            if (hi == lim && hi != pk->last && (size_t)(hi - pk->p) != max)
+                return 0;
+            if (hi != pk->p + min)
+            {
+                scaninit(sc, tregex, &tregex->rev, tregex->flags & TRE_F_END, mem, size);
+                pk->q = pk->last;
+                pk->pick = 0;
+            }
+            else
+                pk->pick = hi;
+        }
+
+        while (pk->q)
+        {
+            if (pk->q <= pk->hi && bitrest(tregex, sc, pos))
+            {
+                pk->pick = pk->q;
+                if (!lazy)
+                    break;
+            }
+            if (pk->q == pk->p + min || scandead(sc))
+                break;
+            if (!*budget)
+                return 0;
+            (*budget)--;
+            scanstep(sc, *--pk->q);
+        }
+
+        pk->p = pk->hi = pk->pick;
+        pk->q = 0;
+        pk->node += 1 + quantof(n + 1, &min, &max);
+        pk->pos = pos;
+    }
+}
+
+// End of the match matchpattern finds from start with greedy and lazy
+// quantifiers. It takes the count of each node in turn, the largest one, or
+// the smallest if lazy, after which the rest of the pattern can match. rev,
+// scanned back from the longest match end, has taken the rest where bitrest
+// holds, so each node costs a scan of the bytes from where it starts.
+static const char *bitend(const tre_comp *tregex, const char *start, const char *tend, void *mem, size_t size)
+{
+    size_t budget = (size_t)-1;
+    tre_pick pk;
+    tre_scan sc;
+
+    scaninit(&sc, tregex, &tregex->fwd, 1, mem, size);
+    pickinit(tregex, &pk, start, bitlast(&sc, start, tend));
+    bitpick(tregex, &pk, &sc, &budget, mem, size);
+    return pk.p;
+}
+
+static const char *matchbits(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                             void *mem, size_t size)
+{
+    const int flags = tregex->flags;
+    const char *start, *mend;
+    tre_scan sc;
+
+    scaninit(&sc, tregex, &tregex->fwd, flags & TRE_F_BEGIN, mem, size);
+    mend = bitfirst(tregex, &sc, text, tend);
+    if (!mend)
+        return 0;
+
+    scaninit(&sc, tregex, &tregex->rev, 1, mem, size);
+    start = bitstart(tregex, &sc, text, mend);
+    if ((flags & TRE_F_GREEDY) && TRE_BEFORE(mend, tend))
+    {
+        if (flags & TRE_F_LAZY)
+            mend = bitend(tregex, start, tend, mem, size);
+        else
+        {
+            scaninit(&sc, tregex, &tregex->fwd, 1, mem, size);
+            mend = bitlast(&sc, start, tend);
+        }
+    }
+
+    if (end) { *end = mend; }
+    return start;
+}
+
+// Literal search
+// --------------
+// A Shift-And pattern with a run of plain characters, like '@example.com' in
+// '\w+@example\.com', is searched for that literal. The first occurrence a
+// match can go through also holds the leftmost match: rev run back from it
+// gives the start, fwd run on from its end tells if the rest can follow.
+// Both programs are entered at the literal position. Should that scan much
+// more than the text, as '\w*a\w*' would on 'aaaa', matchbits takes over.
+
+// End of the match matchpattern finds from start
+static const char *matchend(const tre_comp *tregex, const char *start, const char *tend, void *mem, size_t size)
+{
+    const int flags = tregex->flags;
+    tre_scan sc;
+
+    if ((flags & TRE_F_GREEDY) && (flags & TRE_F_LAZY))
+        return bitend(tregex, start, tend, mem, size);
+
+    scaninit(&sc, tregex, &tregex->fwd, 1, mem, size);
+    return (flags & TRE_F_GREEDY) ? bitlast(&sc, start, tend) : bitfirst(tregex, &sc, start, tend);
+}
+
+static const char *matchliteral(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                                void *mem, size_t size)
+{
+    const size_t len = tregex->litlen, rare = tregex->litrare;
+    const char *o, *start = 0, *mend, *seen = text;
+    size_t budget = tend ? 4 * (size_t)(tend - text) + TRE_LITSLACK : TRE_LITSLACK;
+    tre_scan sc;
+
+    // Up to the NUL byte strchr looks for the rare byte, so the ones before it
+    // have to be there, and a literal holding a NUL is not found at all
+    if (!tend && (tre_strnlen(text, rare) < rare || memchr(tregex->lit, 0, len)))
+        return 0;
+
+    for (o = text; !start && (!tend || (size_t)(tend - o) >= len); o++)
+    {
+        if (tend)
+            o = (const char *)memchr(o + rare, tregex->lit[rare], (tend - o) - len + 1);
+        else
+            o = strchr(o + rare, tregex->lit[rare]);
+        if (!o)
+            break;
+        o -= rare;
+        if (tend ? memcmp(o, tregex->lit, len) : strncmp(o, tregex->lit, len))
+            continue;
+
+        scaninit(&sc, tregex, &tregex->fwd, 1, 0, 0);
+        sc.d = (uint64_t)1 << (tregex->litpos + len - 1);
+        sc.e = 0;
+        mend = bitfirst(tregex, &sc, o + len, tend);
+        if (!tend && o + len + sc.steps > seen)
+        {
+            // Without tend the budget grows with the text seen
+            budget += 4 * (size_t)(o + len + sc.steps - seen);
+            seen = o + len + sc.steps;
+        }
+        if (sc.steps > budget)
+            return matchbits(tregex, text, tend, end, mem, size);
+        budget -= sc.steps;
+        if (!mend)
+            continue;
+
+        scaninit(&sc, tregex, &tregex->rev, 1, 0, 0);
+        sc.d = (uint64_t)1 << (tregex->npos - 1 - tregex->litpos);
+        sc.e = 0;
+        start = bitstart(tregex, &sc, text, o);
+        if (!start && sc.steps > budget)
+            return matchbits(tregex, text, tend, end, mem, size);
+        budget -= sc.steps;
+    }
+
+    if (!start)
+        return 0;
+
+    mend = matchend(tregex, start, tend, mem, size);
+    if (end) { *end = mend; }
+    return start;
+}
+
+// Fixed-width matcher
+// -------------------
+// Without quantifiers of variable count, position i of the Shift-And program
+// takes byte i of the match, so a start is a match if each text byte after it
+// is in the set of its position. With SSE2 the sets are tested as byte ranges
+// on 16 bytes at a time: loading the text at start + i for position i lines
+// the results up by start, and ANDing their movemasks leaves a bit for every
+// one of the 16 starts that matches. The lowest is the leftmost match.
+// Without tend the loads stay within text measured ahead by strnlen, over a
+// stretch doubling each time, so no byte past the NUL is read. With padding
+// they run on to the last start, dropping the starts past it from the bits.
+
+#if (defined(__SSE2__) || defined(_M_X64)) && !defined(TRE_NOSIMD)
+#define TRE_SIMD
+#include "emmintrin.h"
+#endif
+
+static void fixcompile(tre_comp *tregex)
+{
+    const tre_bits *f = &tregex->fwd;
+    unsigned i, c, hi, n;
+
+    if ((tregex->flags & (TRE_F_BITS | TRE_F_BEGIN | TRE_F_END)) != TRE_F_BITS || f->opt || f->rep || f->ncnt)
+        return;
+
+    for (i = 0; i < tregex->npos; i++)
+    {
+        for (c = 0, n = 0; c < 256; c = hi)
+        {
+            for (; c < 256 && !((f->mask[c] >> i) & 1); c++)
+                ;
+            for (hi = c; hi < 256 && ((f->mask[hi] >> i) & 1); hi++)
+                ;
+            if (c == hi)
+                break;
+            if (n == TRE_MAX_RANGES)
+                return; // too scattered, leave it to the others
+            tregex->rangelo[i][n] = c;
+            tregex->rangespan[i][n] = hi - 1 - c;
+            n++;
+        }
+        tregex->nrange[i] = n;
+    }
+#ifdef TRE_SIMD
+    tregex->flags |= TRE_F_FIXED;
+#endif
+}
+
+#ifdef TRE_SIMD
+static unsigned tre_ctz(unsigned x)
+{
+#ifdef __GNUC__
+    return __builtin_ctz(x);
+#else
+    unsigned i = 0;
+    for (; !(x & 1); x >>= 1) { i++; }
+    return i;
+#endif
+}
+#endif
+
+static const char *matchfixed(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                              int padded)
+{
+    const size_t npos = tregex->npos;
+    const char *s = text;
+    size_t i;
+#ifdef TRE_SIMD
+    const __m128i zero = _mm_setzero_si128();
+    const char *known = tend ? tend : text; // end of the text measured so far
+    size_t grow = 128, n;
+    __m128i x, m;
+    unsigned r, hits;
+
+    for (;;)
+    {
+        for (; s < known && (size_t)(known - s) >= npos + (padded ? 0 : 15); s += 16)
+        {
+            hits = 0xFFFF;
+            if ((size_t)(known - s) < npos + 15)
+                hits >>= npos + 15 - (size_t)(known - s); // starts in the padding
+            for (i = 0; i < npos && hits; i++)
+            {
+                x = _mm_loadu_si128((const __m128i *)(s + i));
+                m = zero;
+                for (r = 0; r < tregex->nrange[i]; r++)
+                {
+                    // x - lo wraps below lo, so it is in range if it does not exceed span
+                    __m128i d = _mm_sub_epi8(x, _mm_set1_epi8((char)tregex->rangelo[i][r]));
+                    d = _mm_subs_epu8(d, _mm_set1_epi8((char)tregex->rangespan[i][r]));
+                    m = _mm_or_si128(m, _mm_cmpeq_epi8(d, zero));
+                }
+                hits &= (unsigned)_mm_movemask_epi8(m);
+            }
+            if (hits)
+            {
+                s += tre_ctz(hits);
+                if (end) { *end = s + npos; }
+                return s;
+            }
+        }
+        if (padded)
+            return 0;
+        if (tend)
+            break;
+        n = tre_strnlen(known, grow);
+        known += n;
+        if (n < grow)
+            tend = known;
+        if (grow < 4096) { grow *= 2; }
+    }
+#else
+    (void) padded;
+#endif
+
+    for (;; s++)
+    {
+        for (i = 0; i < npos && TRE_BEFORE(s + i, tend) && ((tregex->fwd.mask[(unsigned char)s[i]] >> i) & 1); i++)
+            ;
+        if (i == npos)
+        {
+            if (end) { *end = s + npos; }
+            return s;
+        }
+        if (!TRE_BEFORE(s + i, tend))
+            return 0;
+    }
+}
+
+// Single node runs
+// ----------------
+// A pattern of one node with a quantifier of at least one, like '\d+' or
+// '[A-Za-z0-9+/]{4,1000}', matches from the start of the first run of bytes
+// the node takes that is min long: a shorter run holds no match, and is
+// passed over whole. Greedy, the match takes the run up to max bytes, lazy,
+// min of them. The bytes of the node are the first position of fwd.
+
+static void spancompile(tre_comp *tregex)
+{
+    const tre_node *n = tregex->nodes;
+    size_t min, max;
+
+    if ((tregex->flags & (TRE_F_BITS | TRE_F_BEGIN | TRE_F_END)) != TRE_F_BITS || n[0].type < TRE_DOT)
+        return;
+    if (quantof(n + 1, &min, &max) && min && n[2].type == TRE_NONE)
+        tregex->flags |= TRE_F_SPAN;
+}
+
+static const char *matchspan(const tre_comp *tregex, const char *text, const char *tend, const char **end)
+{
+    const tre_node *n = tregex->nodes;
+    const uint64_t *mask = tregex->fwd.mask;
+    const char *p = text, *q;
+    size_t min, max;
+
+    quantof(n + 1, &min, &max);
+    for (;;)
+    {
+        while (TRE_BEFORE(p, tend) && !(mask[(unsigned char)*p] & 1))
+            p++;
+        if (!TRE_BEFORE(p, tend))
+            return 0;
+        for (q = p + 1; (size_t)(q - p) < max && TRE_BEFORE(q, tend) && (mask[(unsigned char)*q] & 1); q++)
+            ;
+        if ((size_t)(q - p) >= min)
+            break;
+        p = q;
+    }
+
+    if (end) { *end = (n[1].type == TRE_LPLUS || n[1].type == TRE_LQUANT) ? p + min : q; }
+    return p;
+}
+
+// Jump patterns
+// -------------
+// Where a '.' of variable count is followed by a node that has to take a
+// byte, like 'a.*b' or 'E.*?;', the backtracker goes over the run of '.' with
+// memchr and memrchr, see matchquant, while the scans read every byte of it.
+// Such patterns are backtracked first, for TRE_JUMP_STEPS steps per text
+// byte. Past that they are searched again by the linear-time engines, so
+// the search stays linear: 'a.*b' on a long run of 'a' costs a few memchr
+// passes more than the scans alone. Given memory, as by tre_nmatch_mem, the
+// backtracker memoizes its steps in it where they fit, see btinit.
+
+static void jumpcompile(tre_comp *tregex)
+{
+    const tre_node *n;
+    size_t min, max;
+    int q;
+
+    if (!(tregex->flags & TRE_F_BITS))
+        return;
+    for (n = tregex->nodes; n->type != TRE_NONE; n += 1 + q)
+    {
+        q = quantof(n + 1, &min, &max);
+        if (n->type == TRE_DOT && min != max && takesbyte(n + 1 + q))
+            tregex->flags |= TRE_F_JUMP;
+    }
+}
+
+// Leftmost match in text as matchbacktrack finds it with mem, into start and end.
+// Returns 0 if the backtracker gave up, and 1 with a null start if there is none.
+static int matchjump(const tre_comp *tregex, const char *text, const char *tend, const char **start,
+                     const char **end, void *mem, size_t size)
+{
+    const size_t len = tregex->litlen, rare = tregex->litrare;
+    tre_bt bt;
+
+    // Without the rare byte of the literal there is no match to look for
+    if ((tregex->flags & TRE_F_LIT) && ((size_t)(tend - text) < len ||
+        !memchr(text + rare, tregex->lit[rare], (size_t)(tend - text) - len + 1)))
+    {
+        *start = 0;
+        return 1;
+    }
+
+    btinit(&bt, tregex->nodes + ((tregex->flags & TRE_F_BEGIN) ? 1 : 0), text, tend, mem, size);
+    bt.limit = TRE_JUMP_STEPS * ((size_t)(tend - text) + 1);
+    *start = backtrack(tregex, text, &bt, end);
+    return bt.steps <= bt.limit;
+}
+
+// Resumable matching
+// ------------------
+// tre_ctx_run takes the three scans of matchbits a budget of bytes at a time,
+// and those bitend picks the end of a mixed pattern with, keeping the scan
+// state, DFA cache included, in the tre_ctx in between.
+// Fixed-width patterns are searched a window at a time, as the starts in it
+// are decided by the npos - 1 bytes after it.
+
+enum { TRE_CTX_FIRST, TRE_CTX_START, TRE_CTX_LAST, TRE_CTX_END, TRE_CTX_DONE };
+
+TRE_DEF void tre_ctx_init(tre_ctx *ctx, const tre_comp *tregex, const char *text, size_t tlen,
+                          void *mem, size_t size)
+{
+    ctx->tregex = tregex;
+    ctx->text = ctx->pos = text;
+    ctx->tend = text + tlen;
+    ctx->start = ctx->end = 0;
+    ctx->mem = mem;
+    ctx->size = size;
+    ctx->phase = TRE_CTX_FIRST;
+    ctx->scanning = 0;
+
+    if (!tregex || !text || !tlen)
+    {
+        tre_err("NULL text or tre_comp");
+        ctx->phase = TRE_CTX_DONE;
+    }
+}
+
+static int ctxdone(tre_ctx *ctx, const char *start)
+{
+    ctx->phase = TRE_CTX_DONE;
+    ctx->start = start;
+    if (!start) { ctx->end = 0; }
+    return start != 0;
+}
+
+// Start the scan of the phase of ctx in sc, or resume it
+static void ctxload(tre_ctx *ctx, tre_scan *sc)
+{
+    const tre_comp *tregex = ctx->tregex;
+    const int rev = ctx->phase == TRE_CTX_START || ctx->phase == TRE_CTX_END;
+    const tre_bits *b = rev ? &tregex->rev : &tregex->fwd;
+    int anchored = 1;
+
+    if (!ctx->scanning)
+    {
+        scaninit(sc, tregex, b, tregex->flags & TRE_F_BEGIN, ctx->mem, ctx->size);
+        return;
+    }
+
+    if (ctx->phase == TRE_CTX_FIRST)
+        anchored = tregex->flags & TRE_F_BEGIN;
+    else if (ctx->phase == TRE_CTX_END)
+        anchored = tregex->flags & TRE_F_END;
+    scaninit(sc, tregex, b, anchored, 0, 0);
+    sc->d = ctx->d;
+    sc->e = ctx->e;
+    sc->st = (tre_dstate *)ctx->st;
+    sc->n = ctx->n;
+    sc->cap = ctx->cap;
+    sc->s = ctx->s;
+    if (b->ncnt)
+        sc->cnt = ctx->cnt;
+}
+
+static void ctxsave(tre_ctx *ctx, const tre_scan *sc, const char *pos)
+{
+    ctx->pos = pos;
+    ctx->scanning = 1;
+    ctx->d = sc->d;
+    ctx->e = sc->e;
+    ctx->st = sc->st;
+    ctx->n = sc->n;
+    ctx->cap = sc->cap;
+    ctx->s = sc->s;
+    if (sc->b->ncnt)
+        ctx->cnt = sc->cnt;
+}
+
+static int ctxfixed(tre_ctx *ctx, size_t budget)
+{
+    const size_t more = ctx->tregex->npos - 1;
+    const char *lim = ctx->tend, *start;
+
+    if ((size_t)(lim - ctx->pos) > more && (size_t)(lim - ctx->pos) - more > budget)
+        lim = ctx->pos + budget + more;
+    start = matchfixed(ctx->tregex, ctx->pos, lim, &ctx->end, 0);
+    if (start || lim == ctx->tend)
+        return ctxdone(ctx, start);
+    ctx->pos = lim - more;
+    return TRE_AGAIN;
+}
+
+TRE_DEF int tre_ctx_run(tre_ctx *ctx, size_t budget)
+{
+    const tre_comp *tregex = ctx->tregex;
+    const char *p = ctx->pos;
+    int flags;
+    tre_scan sc;
+
+    if (ctx->phase == TRE_CTX_DONE)
+        return ctx->start != 0;
+    flags = tregex->flags;
+    if (flags & TRE_F_FIXED)
+        return ctxfixed(ctx, budget);
+
+    ctxload(ctx, &sc);
+    for (;;)
+    {
+        if (ctx->phase == TRE_CTX_FIRST)
+        {
+            // Earliest match end, see bitfirst
+            if (scanaccept(&sc) && (!(flags & TRE_F_END) || p == ctx->tend))
+            {
+                ctx->end = p;
+                ctx->phase = TRE_CTX_START;
+                scaninit(&sc, tregex, &tregex->rev, 1, ctx->mem, ctx->size);
+                continue;
+            }
+            if (p == ctx->tend || scandead(&sc))
+                return ctxdone(ctx, ctx->start);
+            if (!budget--)
+                break;
+            scanstep(&sc, *p++);
+        }
+        else if (ctx->phase == TRE_CTX_START)
+        {
+            // Leftmost start, see bitstart
+            if (scanaccept(&sc) && (!(flags & TRE_F_BEGIN) || p == ctx->text))
+                ctx->start = p;
+            if (p == ctx->text || scandead(&sc))
+            {
+                if (!(flags & TRE_F_GREEDY) || ctx->end == ctx->tend)
+                    return ctxdone(ctx, ctx->start);
+                p = ctx->start;
+                ctx->phase = TRE_CTX_LAST;
+                scaninit(&sc, tregex, &tregex->fwd, 1, ctx->mem, ctx->size);
+                continue;
+            }
+            if (!budget--)
+                break;
+            scanstep(&sc, *--p);
+        }
+        else if (ctx->phase == TRE_CTX_LAST)
+        {
+            // Longest match from the start, see bitlast
+            if (scanaccept(&sc))
+                ctx->end = p;
+            if (p == ctx->tend || scandead(&sc))
+            {
+                if (!(flags & TRE_F_LAZY))
+                    return ctxdone(ctx, ctx->start);
+                pickinit(tregex, &ctx->pick, ctx->start, ctx->end);
+                ctx->phase = TRE_CTX_END;
+                continue;
+            }
+            if (!budget--)
+                break;
+            scanstep(&sc, *p++);
+        }
+        else
+        {
+            // End picked node by node, see bitend
+            if (!bitpick(tregex, &ctx->pick, &sc, &budget, ctx->mem, ctx->size))
+                break;
+            ctx->end = ctx->pick.p;
+            return ctxdone(ctx, ctx->start);
+        }
+    }
+
+    ctxsave(ctx, &sc, p);
+    return TRE_AGAIN;
+}
+
+// Eager DFA
+// ---------
+// tre_dfa_build follows the Shift-And states of each scan of matchbits over
+// all byte classes ahead of time, as the lazy DFA does on demand, then merges
+// states that cannot be told apart by Hopcroft's algorithm. The byteclass map
+// comes first, then the table of each scan: a row of next states per state,
+// one per byte class, then a byte per state telling if it accepts. State 0
+// starts a scan. The last scan is only there for greedy patterns.
+
+#define TRE_DFA_MAGIC "tre1"
+
+// States of the scan of b from state 0, written to trans; returns their number,
+// or 0 if there are more than max
+static unsigned dfabuild(const tre_comp *tregex, const tre_bits *b, int anchored,
+                         unsigned char *trans, unsigned char *accept, unsigned max)
+{
+    const unsigned nclass = tregex->nclass;
+    const unsigned char enext = !anchored;
+    unsigned char e[TRE_MAX_DFASTATES], first[256];
+    uint64_t d[TRE_MAX_DFASTATES], x;
+    unsigned n = 1, i, j, c, k = 0;
+
+    if (!max)
+        return 0;
+    for (c = 0; c < 256; c++)
+        if (tregex->byteclass[c] == k) { first[k++] = (unsigned char)c; }
+
+    d[0] = 0;
+    e[0] = 1;
+    for (i = 0; i < n; i++)
+    {
+        accept[i] = (d[i] & b->last) || (e[i] && (tregex->flags & TRE_F_NULL));
+        for (k = 0; k < nclass; k++)
+        {
+            x = bitstep(b, 0, d[i], e[i], first[k]);
+            for (j = 0; j < n && (d[j] != x || e[j] != enext); j++) {}
+            if (j == n)
+            {
+                if (n == max)
+                    return 0;
+                d[n] = x;
+                e[n++] = enext;
+            }
+            trans[i * nclass + k] = (unsigned char)j;
+        }
+    }
+    return n;
+}
+
+// Merge the equivalent states of the n in trans, keeping state 0 first; returns
+// the number left. Blocks start as the accepting and other states and are split
+// until the states of each go to the same blocks on every byte class.
+static unsigned dfaminimize(unsigned char *trans, unsigned char *accept, unsigned n, unsigned nclass)
+{
+    unsigned char blk[TRE_MAX_DFASTATES], in[TRE_MAX_DFASTATES], x[TRE_MAX_DFASTATES];
+    unsigned char work[TRE_MAX_DFASTATES], inwork[TRE_MAX_DFASTATES], id[TRE_MAX_DFASTATES];
+    unsigned short size[TRE_MAX_DFASTATES], cnt[TRE_MAX_DFASTATES];
+    unsigned nb = 1, nwork = 0, nblk, s, b, k, a, z, m = 0;
+
+    memset(size, 0, sizeof(size));
+    for (s = 0; s < n; s++)
+        size[blk[s] = accept[s] != accept[0]]++;
+    if (size[1])
+    {
+        nb = 2;
+        inwork[0] = 0;
+        inwork[1] = 1;
+        work[nwork++] = 1;
+    }
+
+    while (nwork)
+    {
+        a = work[--nwork];
+        inwork[a] = 0;
+        for (s = 0; s < n; s++)
+            in[s] = blk[s] == a;
+        for (k = 0; k < nclass; k++)
+        {
+            // Split each block by which of its states go into a on k
+            memset(cnt, 0, nb * sizeof(*cnt));
+            for (s = 0; s < n; s++)
+                if ((x[s] = in[trans[s * nclass + k]]))
+                    cnt[blk[s]]++;
+            for (b = 0, nblk = nb; b < nblk; b++)
+            {
+                if (!cnt[b] || cnt[b] == size[b])
+                    continue;
+                z = nb++;
+                for (s = 0; s < n; s++)
+                    if (blk[s] == b && !x[s]) { blk[s] = (unsigned char)z; }
+                size[z] = size[b] - cnt[b];
+                size[b] = cnt[b];
+                inwork[z] = 0;
+                if (inwork[b] || size[z] <= size[b]) { work[nwork++] = (unsigned char)z; inwork[z] = 1; }
+                else { work[nwork++] = (unsigned char)b; inwork[b] = 1; }
+            }
+        }
+    }
+
+    // Number the blocks by their first state, whose row comes at or after theirs
+    memset(id, TRE_MAX_DFASTATES, sizeof(id));
+    for (s = 0; s < n; s++)
+    {
+        if (id[blk[s]] != TRE_MAX_DFASTATES)
+            continue;
+        id[blk[s]] = (unsigned char)m;
+        memmove(trans + m * nclass, trans + s * nclass, nclass);
+        accept[m++] = accept[s];
+    }
+    for (s = 0; s < m * nclass; s++)
+        trans[s] = id[blk[trans[s]]];
+    return m;
+}
+
+// State of the n in trans going nowhere but to itself without accepting, or TRE_MAX_DFASTATES
+static unsigned char dfadead(const unsigned char *trans, const unsigned char *accept, unsigned n, unsigned nclass)
+{
+    unsigned s, k;
+
+    for (s = 0; s < n; s++)
+    {
+        for (k = 0; k < nclass && trans[s * nclass + k] == s; k++) {}
+        if (k == nclass && !accept[s])
+            return (unsigned char)s;
+    }
+    return TRE_MAX_DFASTATES;
+}
+
+TRE_DEF size_t tre_dfa_build(const tre_comp *tregex, void *buf, size_t size)
+{
+    const int flags = tregex->flags;
+    const unsigned nclass = tregex->nclass;
+    tre_dfa *dfa = (tre_dfa *)buf;
+    unsigned char *p = (unsigned char *)buf + sizeof(tre_dfa) + 256, accept[TRE_MAX_DFASTATES];
+    size_t room;
+    unsigned k, n;
+
+    if (!(flags & TRE_F_BITS) || tregex->fwd.ncnt)
+        return tre_err("Pattern too large for a DFA");
+    if ((flags & TRE_F_GREEDY) && (flags & TRE_F_LAZY))
+        return tre_err("Greedy and lazy quantifiers mixed in a DFA");
+    if (size < sizeof(tre_dfa) + 256)
+        return tre_err("DFA buffer too small");
+
+    memset(dfa, 0, sizeof(tre_dfa));
+    memcpy(dfa->magic, TRE_DFA_MAGIC, 4);
+    dfa->flags = flags;
+    dfa->nclass = nclass;
+    memcpy(dfa + 1, tregex->byteclass, 256);
+    dfa->dead[2] = TRE_MAX_DFASTATES; // no last scan without greedy quantifiers
+    for (k = 0; k < ((flags & TRE_F_GREEDY) ? 3u : 2u); k++)
+    {
+        room = (size - (size_t)(p - (unsigned char *)buf)) / (nclass + 1);
+        n = dfabuild(tregex, (k == 1) ? &tregex->rev : &tregex->fwd, k || (flags & TRE_F_BEGIN), p, accept,
+                     (room < TRE_MAX_DFASTATES) ? (unsigned)room : TRE_MAX_DFASTATES);
+        if (!n)
+            return tre_err("DFA has too many states");
+        n = dfaminimize(p, accept, n, nclass);
+        memcpy(p + n * nclass, accept, n);
+        dfa->nstate[k] = (unsigned char)n;
+        dfa->dead[k] = dfadead(p, accept, n, nclass);
+        p += n * (nclass + 1);
+    }
+    dfa->size = (uint32_t)(p - (unsigned char *)buf);
+    return dfa->size;
+}
+
+TRE_DEF const tre_dfa *tre_dfa_load(const void *buf, size_t size)
+{
+    const tre_dfa *dfa = (const tre_dfa *)buf;
+    const unsigned char *p = (const unsigned char *)buf + sizeof(tre_dfa);
+    size_t i, need = sizeof(tre_dfa) + 256;
+    unsigned k, n;
+
+    if (!buf || size < need || memcmp(dfa->magic, TRE_DFA_MAGIC, 4) || dfa->size != size ||
+        !dfa->nclass || dfa->nclass > 256 || !(dfa->flags & TRE_F_BITS) || !dfa->nstate[0] || !dfa->nstate[1] ||
+        !dfa->nstate[2] != !(dfa->flags & TRE_F_GREEDY) || ((dfa->flags & TRE_F_GREEDY) && (dfa->flags & TRE_F_LAZY)))
+        return 0;
+    for (k = 0; k < 3; k++)
+        need += dfa->nstate[k] * (dfa->nclass + 1);
+    if (need != size)
+        return 0;
+
+    for (i = 0; i < 256; i++)
+        if (p[i] >= dfa->nclass)
+            return 0;
+    p += 256;
+    for (k = 0; k < 3; k++)
+    {
+        n = dfa->nstate[k];
+        if (n && dfa->dead[k] >= n && dfa->dead[k] != TRE_MAX_DFASTATES)
+            return 0;
+        for (i = 0; i < n * dfa->nclass; i++)
+            if (p[i] >= n)
+                return 0;
+        p += n * (dfa->nclass + 1);
+    }
+    return dfa;
+}
+
+TRE_DEF const char *tre_dfa_nmatch(const tre_dfa *dfa, const char *text, size_t tlen, const char **end)
+{
+    const int flags = dfa ? dfa->flags : 0;
+    const unsigned nclass = dfa ? dfa->nclass : 0;
+    const char *tend = text + tlen, *p = text, *start = 0, *mend;
+    const unsigned char *cls, *trans, *accept;
+    unsigned s = 0, dead;
+
+    if (!dfa || !text || !tlen)
+    {
+        tre_err("NULL text or tre_dfa");
+        return 0;
+    }
+
+    // Earliest match end
+    cls = (const unsigned char *)(dfa + 1);
+    trans = cls + 256;
+    accept = trans + dfa->nstate[0] * nclass;
+    dead = dfa->dead[0];
+    if (flags & TRE_F_END)
+    {
+        while (p < tend && s != dead)
+            s = trans[s * nclass + cls[(unsigned char)*p++]];
+        if (p < tend || !accept[s])
+            return 0;
+    }
+    else
+    {
+        while (!accept[s])
+        {
+            if (p == tend || s == dead)
+                return 0;
+            s = trans[s * nclass + cls[(unsigned char)*p++]];
+        }
+    }
+    mend = p;
+
+    // Leftmost start of a match ending there
+    trans = accept + dfa->nstate[0];
+    accept = trans + dfa->nstate[1] * nclass;
+    dead = dfa->dead[1];
+    for (s = 0;; )
+    {
+        if (accept[s] && (!(flags & TRE_F_BEGIN) || p == text))
+            start = p;
+        if (p == text || s == dead)
+            break;
+        s = trans[s * nclass + cls[(unsigned char)*--p]];
+    }
+
+    // Longest match from there
+    if ((flags & TRE_F_GREEDY) && mend != tend)
+    {
+        trans = accept + dfa->nstate[1];
+        accept = trans + dfa->nstate[2] * nclass;
+        dead = dfa->dead[2];
+        for (s = 0, p = start;; )
+        {
+            if (accept[s])
+                mend = p;
+            if (p == tend || s == dead)
+                break;
+            s = trans[s * nclass + cls[(unsigned char)*p++]];
+        }
+    }
+
+    if (end) { *end = mend; }
+    return start;
+}
+
+// Pattern sets
+// ------------
+// Each pattern takes the next npos bits of the first word with room left,
+// plus a spare bit above them that accepts no byte. It stops d shifting into
+// the next pattern and the carry of optional positions running into it.
+
+TRE_DEF void tre_set_init(tre_set *set)
+{
+    memset(set, 0, sizeof(tre_set));
+}
+
+TRE_DEF int tre_set_add(tre_set *set, const tre_comp *tregex)
+{
+    const tre_bits *f = &tregex->fwd;
+    const unsigned p = tregex->npos, k = set->n;
+    const int flags = tregex->flags;
+    unsigned w = 0, o, c;
+
+    if (!(flags & TRE_F_BITS) || f->ncnt)
+        return tre_err("Pattern not supported in a set");
+    if (k == TRE_MAX_SET)
+        return tre_err("Too many patterns in a set");
+    while (p && w < TRE_SET_WORDS && set->used[w] + p > 64) { w++; }
+    if (w == TRE_SET_WORDS)
+        return tre_err("No room left in a set");
+
+    set->n++;
+    set->word[k] = (unsigned char)w;
+    if ((flags & TRE_F_NULL) && (~flags & (TRE_F_BEGIN | TRE_F_END)))
+        set->null |= (uint64_t)1 << k;
+    if (!p)
+        return 1;
+
+    o = set->used[w];
+    set->used[w] = (unsigned char)((o + p < 64) ? o + p + 1 : 64);
+    set->last[k] = f->last << o;
+    set->opt[w] |= f->opt << o;
+    set->rep[w] |= f->rep << o;
+    if (flags & TRE_F_BEGIN)
+        set->begin[w] |= (uint64_t)1 << o;
+    else
+        set->enter[w] |= (uint64_t)1 << o;
+    if (flags & TRE_F_END)
+        set->lastend[w] |= set->last[k];
+    else
+        set->lastany[w] |= set->last[k];
+    for (c = 0; c < 256; c++)
+        set->mask[c][w] |= f->mask[c] << o;
+    return 1;
+}
+
+TRE_DEF uint64_t tre_set_nmatch(const tre_set *set, const char *text, size_t tlen)
+{
+    const char *tend = text + tlen;
+    uint64_t d[TRE_SET_WORDS], e[TRE_SET_WORDS], hit[TRE_SET_WORDS], x, live, found;
+    const uint64_t *m;
+    unsigned w, k;
+
+    if (!set || !text || !tlen)
+    {
+        tre_err("NULL text or tre_set");
+        return 0;
+    }
+
+    for (w = 0; w < TRE_SET_WORDS; w++)
+    {
+        d[w] = hit[w] = 0;
+        e[w] = set->enter[w] | set->begin[w];
+    }
+    for (live = 1; text < tend && live; )
+    {
+        m = set->mask[(unsigned char)*text++];
+        live = 0;
+        for (w = 0; w < TRE_SET_WORDS; w++)
+        {
+            x = (d[w] << 1) | e[w];
+            x |= (set->opt[w] + (x & set->opt[w])) ^ set->opt[w];
+            d[w] = (x | (d[w] & set->rep[w])) & m[w];
+            hit[w] |= d[w] & set->lastany[w];
+            e[w] = set->enter[w];
+            live |= d[w] | e[w];
+        }
+    }
+    if (text == tend)
+        for (w = 0; w < TRE_SET_WORDS; w++)
+            hit[w] |= d[w] & set->lastend[w];
+
+    found = set->null;
+    for (k = 0; k < set->n; k++)
+        if (hit[set->word[k]] & set->last[k])
+            found |= (uint64_t)1 << k;
+    return found;
+}
+
+// Lexer
+// -----
+// The rules are packed as in a set and entered at the token start only. At
+// each byte accepted by some rule the token grows to it, won by the first of
+// those rules, which holds the lowest accepting bit of its word as rules are
+// packed in order.
+
+TRE_DEF void tre_lexer_init(tre_lexer *lex)
+{
+    tre_set_init(&lex->set);
+    memset(lex->rule, 0, sizeof(lex->rule));
+}
+
+TRE_DEF int tre_lexer_add(tre_lexer *lex, const tre_comp *tregex)
+{
+    unsigned char used[TRE_SET_WORDS];
+    unsigned w, b;
+
+    memcpy(used, lex->set.used, sizeof(used));
+    if (!tre_set_add(&lex->set, tregex))
+        return 0;
+    w = lex->set.word[lex->set.n - 1];
+    for (b = used[w]; b < lex->set.used[w]; b++)
+        lex->rule[w][b] = (unsigned char)(lex->set.n - 1);
+    return 1;
+}
+
+// Index of the lowest set bit of x, which is not 0
+static unsigned tre_ctz64(uint64_t x)
+{
+#ifdef __GNUC__
+    return (unsigned)__builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    for (; !(x & 1); x >>= 1) { n++; }
+    return n;
+#endif
+}
+
+TRE_DEF int tre_lex(const tre_lexer *lex, const char *text, size_t tlen, const char **end)
+{
+    const tre_set *set = &lex->set;
+    const char *tend = text + tlen, *p = text;
+    uint64_t d[TRE_SET_WORDS], e[TRE_SET_WORDS], x, hit, live = 1;
+    const uint64_t *m;
+    unsigned w, r, best = TRE_MAX_SET;
+
+    if (!text || !tlen)
+        return -1;
+    for (w = 0; w < TRE_SET_WORDS; w++)
+    {
+        d[w] = 0;
+        e[w] = set->enter[w] | set->begin[w];
+    }
+
+    while (p < tend && live)
+    {
+        m = set->mask[(unsigned char)*p++];
+        live = 0;
+        r = TRE_MAX_SET;
+        for (w = 0; w < TRE_SET_WORDS; w++)
+        {
+            x = (d[w] << 1) | e[w];
+            x |= (set->opt[w] + (x & set->opt[w])) ^ set->opt[w];
+            d[w] = (x | (d[w] & set->rep[w])) & m[w];
+            e[w] = 0;
+            live |= d[w];
+            hit = d[w] & (set->lastany[w] | ((p == tend) ? set->lastend[w] : 0));
+            if (hit && lex->rule[w][tre_ctz64(hit)] < r)
+                r = lex->rule[w][tre_ctz64(hit)];
+        }
+        if (r != TRE_MAX_SET)
+        {
+            best = r;
+            if (end) { *end = p; }
+        }
+    }
+    return (best != TRE_MAX_SET) ? (int)best : -1;
+}
+
+// One-pass matcher
+// ----------------
+// A ^ pattern is one-pass if no byte can be taken by two nodes at any point:
+// every node with a choice between repeating and moving on accepts no byte of
+// the nodes it can move on to, up to the first required one. Such a pattern
+// is matched by a single forward walk in which the next byte picks the node.
+// Only where the match can end is there still a choice, made as matchpattern
+// would: a lazy node ends it there, a greedy one goes on. Without $ the match
+// can end at every byte after that, so the walk never has to step back.
+
+// Node after node n and its quantifier
+static const tre_node *nextatom(const tre_node *n)
+{
+    size_t min, max;
+    return n + 1 + quantof(n + 1, &min, &max);
+}
+
+static void onepasscompile(tre_comp *tregex)
+{
+    const tre_node *n = tregex->nodes, *q;
+    size_t min, max, qmin, qmax;
+    unsigned c;
+
+    if (n->type != TRE_BEGIN)
+        return;
+
+    for (n++; n->type != TRE_NONE; n = nextatom(n))
+    {
+        if (n->type == TRE_END && n[1].type == TRE_NONE)
+            break;
+        if (n->type == TRE_BEGIN || n->type == TRE_END)
+            return; // stray, leave it to matchpattern
+
+        quantof(n + 1, &min, &max);
+        if (min == max)
+            continue;
+
+        for (q = nextatom(n); q->type != TRE_NONE && q->type != TRE_END; q = nextatom(q))
+        {
+            for (c = 0; c < 256; c++)
+                if (matchone(n, (char)c) && matchone(q, (char)c))
+                    return;
+            quantof(q + 1, &qmin, &qmax);
+            if (qmin)
+                break;
+        }
+    }
+    tregex->flags |= TRE_F_ONEPASS;
+}
+
+// Can the match end at text, after k repeats of node n
+static int onepassend(const tre_node *n, size_t k, const char *text, const char *tend)
+{
+    size_t min, max;
+
+    for (; n->type != TRE_NONE; n = nextatom(n), k = 0)
+    {
+        if (n->type == TRE_END)
+            return !TRE_BEFORE(text, tend);
+        quantof(n + 1, &min, &max);
+        if (k < min)
+            return 0;
+    }
+    return 1;
+}
+
+static const char *matchonepass(const tre_comp *tregex, const char *text, const char *tend, const char **end)
+{
+    const tre_node *n = tregex->nodes + 1, *q, *next;
+    const char *start = text;
+    size_t min, max, k = 0, i;
+    int lazy;
+
+    for (;;)
+    {
+        // Node taking the next byte, moving on from n after k repeats
+        next = 0;
+        for (q = n, i = k; TRE_BEFORE(text, tend) && q->type != TRE_NONE && q->type != TRE_END; q = nextatom(q), i = 0)
+        {
+            quantof(q + 1, &min, &max);
+            if (i < max && matchone(q, *text))
+            {
+                next = q;
+                break;
+            }
+            if (i < min)
+                break;
+        }
+
+        if (!next)
+        {
+            if (!onepassend(n, k, text, tend))
+                return 0;
+            break;
+        }
+        switch (next[1].type)
+        {
+        case TRE_LQMARK: case TRE_LSTAR: case TRE_LPLUS: case TRE_LQUANT:
+            if (onepassend(n, k, text, tend))
+            {
+                if (end) { *end = text; }
+                return start;
+            }
+            lazy = 1;
+            break;
+        default:
+            lazy = 0;
+        }
+
+        k = (next == n) ? k + 1 : 1;
+        n = next;
+        text++;
+
+        // A greedy node takes all it can
+        if (!lazy)
+        {
+            quantof(n + 1, &min, &max);
+            while (k < max && TRE_BEFORE(text, tend) && matchone(n, *text)) { text++; k++; }
+        }
+    }
+
+    if (end) { *end = text; }
+    return start;
+}
+
+// Scratch memory
+// --------------
+
+TRE_DEF size_t tre_scratch_size(const tre_comp *tregex, size_t tlen)
+{
+    const tre_node *nodes = tregex->nodes + ((tregex->flags & TRE_F_BEGIN) ? 1 : 0);
+    size_t n = 1, bits, size = 0;
+
+    // Lazy DFA cache, aligned to 8 bytes, see scaninit
+    if ((tregex->flags & TRE_F_BITS) && !tregex->fwd.ncnt)
+        size = TRE_DFA_STATES * sizeof(tre_dstate) + 7;
+
+    // Visited bitset of the backtracker, see btinit
+    while (nodes[n - 1].type != TRE_NONE) { n++; }
+    bits = (tlen < TRE_BITSTATE_BITS) ? n * (tlen + 1) : TRE_BITSTATE_BITS;
+    if (bits > TRE_BITSTATE_BITS) { bits = TRE_BITSTATE_BITS; }
+    return (bits / 8 + 1 > size) ? bits / 8 + 1 : size;
+}
+
+TRE_DEF void tre_scratch_init(tre_scratch *scratch, void *mem, size_t size)
+{
+    scratch->mem = mem;
+    scratch->size = size;
+    scratch->nfallback = 0;
+}
+
+TRE_DEF const char *tre_nmatch_scratch(const tre_comp *tregex, const char *text, size_t tlen, const char **end,
+                                       tre_scratch *scratch)
+{
+    if (!scratch)
+        return tre_nmatch_mem(tregex, text, tlen, end, 0, 0);
+    return tre_nmatch_mem(tregex, text, tlen, end, scratch->mem, scratch->size);
+}
+
+TRE_DEF const char *tre_nmatch_safe(const tre_comp *tregex, const char *text, size_t tlen, const char **end,
+                                    tre_scratch *scratch)
+{
+    const char *start;
+    tre_bt bt;
+
+    if (!tregex || !text || !tlen)
+    {
+        tre_err("NULL text or tre_comp");
+        return 0;
+    }
+
+    // Marks the (node, byte) pairs tried in scratch if it has room, see tre_scratch_size
+    btinit(&bt, tregex->nodes + ((tregex->flags & TRE_F_BEGIN) ? 1 : 0), text, text + tlen,
+           scratch ? scratch->mem : 0, scratch ? scratch->size : 0);
+    bt.limit = TRE_SAFE_STEPS * (tlen + 1);
+    start = backtrack(tregex, text, &bt, end);
+    if (bt.steps <= bt.limit)
+        return start;
+
+    // Sub-searches cut short may have failed, so start over
+    if (scratch) { scratch->nfallback++; }
+    return tre_nmatch_scratch(tregex, text, tlen, end, scratch);
+}
+
+// Approximate matching
+// --------------------
+// Wu and Manber's extension of Shift-And: level j holds the states reached
+// with j errors and is fed by level j - 1 through a substituted byte, which
+// any entered position takes, an inserted byte, which leaves the state as it
+// is (covering a repeating position taking a wrong byte), and a deleted
+// position, entered without taking a byte.
+// An anchored scan keeps the entry open to level j for j inserted bytes.
+
+static void fuzzinit(const tre_bits *b, uint64_t *d, unsigned k)
+{
+    unsigned j;
+    d[0] = 0;
+    for (j = 1; j <= k; j++)
+        d[j] = bitenter(b, d[j - 1], 1);
+}
+
+// Step levels 0 to k over c, the t-th byte of the scan
+static void fuzzstep(const tre_bits *b, uint64_t *d, unsigned k, int anchored, size_t t, unsigned char c)
+{
+    uint64_t prev = d[0], cur;
+    unsigned j;
+
+    d[0] = bitstep(b, 0, d[0], !anchored || t == 0, c);
+    for (j = 1; j <= k; j++)
+    {
+        cur = d[j];
+        d[j] = bitstep(b, 0, cur, !anchored || t <= j, c)
+             | bitenter(b, prev, !anchored || t <= j - 1)           // substituted
+             | prev                                                 // inserted
+             | bitenter(b, d[j - 1], !anchored || t + 1 <= j - 1); // deleted
+        prev = cur;
+    }
+}
+
+// Lowest level accepting after t bytes, or k + 1
+static unsigned fuzzaccept(const tre_comp *tregex, const tre_bits *b, const uint64_t *d, unsigned k,
+                           int anchored, size_t t)
+{
+    unsigned j;
+    for (j = 0; j <= k; j++)
+        if ((d[j] & b->last) || ((tregex->flags & TRE_F_NULL) && (!anchored || t <= j)))
+            break;
+    return j;
+}
+
+// Nothing left to match at any level of an anchored scan
+static int fuzzdead(const uint64_t *d, unsigned k, size_t t)
+{
+    unsigned j;
+    for (j = 0; j <= k; j++)
+        if (d[j] || t <= j)
+            return 0;
+    return 1;
+}
+
+TRE_DEF const char *tre_nmatch_fuzzy(const tre_comp *tregex, const char *text, size_t tlen, unsigned k,
+                                     const char **end, unsigned *dist)
+{
+    const char *tend = text + tlen, *mend = 0, *start = 0, *p;
+    uint64_t d[TRE_MAX_ERRORS + 1];
+    unsigned best, j;
+    int begin;
+    size_t t;
+
+    if (!tregex || !text)
+    {
+        tre_err("NULL text or tre_comp");
+        return 0;
+    }
+    if (!(tregex->flags & TRE_F_BITS) || tregex->fwd.ncnt || k > TRE_MAX_ERRORS)
+    {
+        tre_err("Pattern or error count not supported by fuzzy matching");
+        return 0;
+    }
+    begin = tregex->flags & TRE_F_BEGIN;
+
+    // Earliest end with the fewest errors
+    best = k + 1;
+    fuzzinit(&tregex->fwd, d, k);
+    for (p = text, t = 0; ; p++, t++)
+    {
+        if (!(tregex->flags & TRE_F_END) || p == tend)
+        {
+            j = fuzzaccept(tregex, &tregex->fwd, d, k, begin, t);
+            if (j < best)
+            {
+                best = j;
+                mend = p;
+                if (!j)
+                    break;
+            }
+        }
+        if (p == tend || (begin && fuzzdead(d, k, t)))
+            break;
+        fuzzstep(&tregex->fwd, d, k, begin, t, *p);
+    }
+    if (best > k)
+        return 0;
+
+    // Leftmost start of a match ending there with as many errors
+    fuzzinit(&tregex->rev, d, best);
+    for (p = mend, t = 0; ; t++)
+    {
+        if ((!begin || p == text) && fuzzaccept(tregex, &tregex->rev, d, best, 1, t) <= best)
+            start = p;
+        if (p == text || fuzzdead(d, best, t))
+            break;
+        fuzzstep(&tregex->rev, d, best, 1, t, *--p);
+    }
+
+    if (end) { *end = mend; }
+    if (dist) { *dist = best; }
+    return start;
+}
+
+void tre_print(const tre_comp *tregex)
+{
+#ifdef TRE_SILENT
+    (void) tregex;
+#else
+#define X(A) #A,
+    static const char *tre_typenames[] = { TRE_TYPES_X };
+#undef X
+
+    if (!tregex)
+    {
+        printf("NULL compiled regex detected\n");
+        return;
+    }
+
+    const tre_node *tnode = tregex->nodes;
+    int i;
+    for (i = 0; i < TRE_MAX_NODES; ++i)
+    {
+        if (tnode[i].type == TRE_NONE)
+            break;
+
+        printf("type: %s", tre_typenames[tnode[i].type]);
+        if (tnode[i].type == TRE_CLASS || tnode[i].type == TRE_NCLASS)
+        {
+            printf(" \"%s\"", tnode[i].ccl);
+        }
+        else if (tnode[i].type == TRE_QUANT || tnode[i].type == TRE_LQUANT)
+        {
+            if (tnode[i].mn[1] == TRE_QUANTINF)
+                printf(" {%d,}", tnode[i].mn[0]);
+            else
+                printf(" {%d,%d}", tnode[i].mn[0], tnode[i].mn[1]);
+        }
+        else if (tnode[i].type == TRE_CHAR)
+        {
+            printf(" '%c'", tnode[i].ch);
+        }
+        printf("\n");
+    }
+
+    if (tregex->flags & TRE_F_LIT)
+    {
+        printf("literal: \"%.*s\" at position %d, memchr for '%c'\n",
+               tregex->litlen, tregex->lit, tregex->litpos, tregex->lit[tregex->litrare]);
+    }
+    if (tregex->flags & TRE_F_FIXED)
+    {
+        printf("fixed width: %d\n", tregex->npos);
+    }
+    if (tregex->flags & TRE_F_SPAN)
+    {
+        printf("single node run\n");
+    }
+    if (tregex->flags & TRE_F_JUMP)
+    {
+        printf("backtracked first\n");
+    }
+    if (tregex->flags & TRE_F_BITS)
+    {
+        printf("byte classes: %d\n", tregex->nclass);
     }
 #endif // TRE_SILENT
 }
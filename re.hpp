@@ -0,0 +1,269 @@
+// C++17 interface to re.h
+//
+// tre::regex owns a compiled pattern in memory from a std::pmr resource. It is
+// move-only: tre_comp points into itself, so it stays where it was compiled,
+// and moving it to another resource compiles the pattern again there.
+// Texts are std::string_view and matches are views into them. Searching and
+// iterating over matches never allocate. A pattern that does not compile
+// throws regex_error, so re.c is best built with TRE_SILENT. The empty
+// pattern, which re.h does not compile, matches every text.
+//
+//   tre::regex re("\\d+");
+//   for (std::string_view m : re.find_all("a1b22c333"))
+//       ...
+
+#ifndef TRE_RE_HPP_INCLUDE
+#define TRE_RE_HPP_INCLUDE
+
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <memory_resource>
+#include <new>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+
+#include "re.h"
+
+namespace tre
+{
+
+class match_range;
+
+// Thrown by regex for a pattern that does not compile
+class regex_error : public std::runtime_error
+{
+public:
+    using std::runtime_error::runtime_error;
+};
+
+class regex
+{
+public:
+    using allocator_type = std::pmr::polymorphic_allocator<std::byte>;
+
+    // Compile pattern into memory from alloc
+    explicit regex(std::string_view pattern, const allocator_type &alloc = {}) : mr_(alloc.resource())
+    {
+        compile(pattern);
+    }
+
+    regex(regex &&other) noexcept
+        : comp_(std::exchange(other.comp_, nullptr)), mr_(other.mr_), plen_(other.plen_),
+          any_(std::exchange(other.any_, false)), anchored_(other.anchored_), nullable_(other.nullable_)
+    {
+    }
+
+    // Same with the memory from alloc: the compiled pattern moves over if other
+    // has it from the same resource, else it is compiled again and other kept
+    regex(regex &&other, const allocator_type &alloc) : mr_(alloc.resource())
+    {
+        if (mr_->is_equal(*other.mr_))
+        {
+            comp_ = std::exchange(other.comp_, nullptr);
+            plen_ = other.plen_;
+            any_ = std::exchange(other.any_, false);
+            anchored_ = other.anchored_;
+            nullable_ = other.nullable_;
+        }
+        else if (other)
+            compile(other.pattern());
+    }
+
+    regex &operator=(regex &&other) noexcept
+    {
+        if (this != &other)
+        {
+            release();
+            comp_ = std::exchange(other.comp_, nullptr);
+            mr_ = other.mr_;
+            plen_ = other.plen_;
+            any_ = std::exchange(other.any_, false);
+            anchored_ = other.anchored_;
+            nullable_ = other.nullable_;
+        }
+        return *this;
+    }
+
+    regex(const regex &) = delete;
+    regex &operator=(const regex &) = delete;
+
+    ~regex() { release(); }
+
+    // False once moved from
+    explicit operator bool() const noexcept { return comp_ != nullptr || any_; }
+
+    // Only for a compiled pattern: not the empty one, and not once moved from
+    const tre_comp &comp() const noexcept
+    {
+        assert(comp_ && "tre::regex::comp: no compiled pattern");
+        return *comp_;
+    }
+
+    // Source of the pattern, kept after the tre_comp
+    std::string_view pattern() const noexcept
+    {
+        return comp_ ? std::string_view(reinterpret_cast<const char *>(comp_ + 1), plen_) : std::string_view();
+    }
+
+    allocator_type get_allocator() const noexcept { return allocator_type(mr_); }
+    std::pmr::memory_resource *resource() const noexcept { return mr_; }
+    bool anchored() const noexcept { return anchored_; }
+
+    // Leftmost match in text, with the memory of scratch if not null, see tre_nmatch_scratch
+    std::optional<std::string_view> search(std::string_view text, tre_scratch *scratch = nullptr) const noexcept
+    {
+        const char *end;
+        const char *m;
+
+        // re.h takes no empty text, where only an empty match can be
+        if ((!comp_ && !any_) || (text.empty() && !nullable_))
+            return std::nullopt;
+        if (text.empty() || any_)
+            return text.substr(0, 0);
+        m = tre_nmatch_scratch(comp_, text.data(), text.size(), &end, scratch);
+        if (!m)
+            return std::nullopt;
+        return std::string_view(m, static_cast<std::size_t>(end - m));
+    }
+
+    // Lazy range over the matches in text, each searched for from the end of the last
+    inline match_range find_all(std::string_view text, tre_scratch *scratch = nullptr) const noexcept;
+
+private:
+    // Into a tre_comp followed by the pattern, or nothing for the empty one
+    void compile(std::string_view pattern)
+    {
+        anchored_ = !pattern.empty() && pattern[0] == '^';
+        if (pattern.empty())
+        {
+            any_ = nullable_ = true;
+            return;
+        }
+
+        void *p = mr_->allocate(sizeof(tre_comp) + pattern.size(), alignof(tre_comp));
+        comp_ = new (p) tre_comp;
+        if (!tre_ncompile(pattern.data(), pattern.size(), comp_))
+        {
+            mr_->deallocate(p, sizeof(tre_comp) + pattern.size(), alignof(tre_comp));
+            comp_ = nullptr;
+            throw regex_error("tre::regex: pattern does not compile");
+        }
+        std::memcpy(comp_ + 1, pattern.data(), pattern.size());
+        plen_ = pattern.size();
+        nullable_ = tre_nullable(comp_) != 0;
+    }
+
+    void release() noexcept
+    {
+        if (comp_)
+            mr_->deallocate(comp_, sizeof(tre_comp) + plen_, alignof(tre_comp));
+        comp_ = nullptr;
+    }
+
+    tre_comp *comp_ = nullptr;
+    std::pmr::memory_resource *mr_;
+    std::size_t plen_ = 0;  // bytes of the pattern
+    bool any_ = false;      // the empty pattern
+    bool anchored_ = false;
+    bool nullable_ = false;
+};
+
+// Matches of a regex in a text. An empty match is followed by a search from
+// the next byte, up to the empty text past the last one, and a '^' pattern
+// matches at most once.
+class match_iterator
+{
+public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view *;
+    using reference = const std::string_view &;
+
+    // End of any range
+    match_iterator() noexcept = default;
+
+    match_iterator(const regex &re, std::string_view text, tre_scratch *scratch) noexcept
+        : re_(&re), text_(text), scratch_(scratch)
+    {
+        find(text_.data());
+    }
+
+    reference operator*() const noexcept { return match_; }
+    pointer operator->() const noexcept { return &match_; }
+
+    match_iterator &operator++() noexcept
+    {
+        const char *next = match_.data() + match_.size() + (match_.empty() ? 1 : 0);
+        if (re_->anchored())
+            re_ = nullptr;
+        else
+            find(next);
+        return *this;
+    }
+
+    match_iterator operator++(int) noexcept
+    {
+        match_iterator old = *this;
+        ++*this;
+        return old;
+    }
+
+    friend bool operator==(const match_iterator &a, const match_iterator &b) noexcept
+    {
+        if (!a.re_ || !b.re_)
+            return a.re_ == b.re_;
+        return a.match_.data() == b.match_.data() && a.match_.size() == b.match_.size();
+    }
+
+    friend bool operator!=(const match_iterator &a, const match_iterator &b) noexcept { return !(a == b); }
+
+private:
+    void find(const char *from) noexcept
+    {
+        const std::size_t done = static_cast<std::size_t>(from - text_.data());
+        std::optional<std::string_view> m;
+
+        if (done <= text_.size())
+            m = re_->search(text_.substr(done), scratch_);
+        if (m)
+            match_ = *m;
+        else
+            re_ = nullptr;
+    }
+
+    const regex *re_ = nullptr;
+    std::string_view text_;
+    std::string_view match_;
+    tre_scratch *scratch_ = nullptr;
+};
+
+class match_range
+{
+public:
+    match_range(const regex &re, std::string_view text, tre_scratch *scratch) noexcept
+        : re_(&re), text_(text), scratch_(scratch)
+    {
+    }
+
+    match_iterator begin() const noexcept { return match_iterator(*re_, text_, scratch_); }
+    match_iterator end() const noexcept { return match_iterator(); }
+
+private:
+    const regex *re_;
+    std::string_view text_;
+    tre_scratch *scratch_;
+};
+
+inline match_range regex::find_all(std::string_view text, tre_scratch *scratch) const noexcept
+{
+    return match_range(*this, text, scratch);
+}
+
+} // namespace tre
+
+#endif // TRE_RE_HPP_INCLUDE
@@ -0,0 +1,423 @@
+// std::regex look-alike on top of re.hpp
+//
+// tre_std holds regex, match_results, regex_search and regex_match with the
+// signatures of their std counterparts, so hot paths move over by changing
+// the namespace. Patterns are ECMAScript without groups, alternation, word
+// boundaries, backreferences or lookarounds, counts past 1024 or more nodes
+// than a tre_comp holds, and the multiline flag. Escapes are the ones of re.h:
+// '\n' and the like are not newlines, and a pattern using them is refused
+// with an unsupported_error saying what is missing, which is a
+// std::regex_error as well. There is one sub-match, the whole match. Texts are
+// contiguous: const char * ranges and std::string iterators. Build re.c with
+// TRE_SILENT, as errors are thrown and need not be printed as well.
+
+#ifndef TRE_RE_STD_HPP_INCLUDE
+#define TRE_RE_STD_HPP_INCLUDE
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <optional>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+#include "re.hpp"
+
+namespace tre_std
+{
+
+namespace regex_constants = std::regex_constants;
+
+// Thrown for a pattern or flag re.h has no equivalent for
+class unsupported_error : public std::regex_error
+{
+public:
+    explicit unsupported_error(const char *what)
+        : std::regex_error(std::regex_constants::error_complexity), what_(what)
+    {
+    }
+
+    const char *what() const noexcept override { return what_; }
+
+private:
+    const char *what_;
+};
+
+class regex
+{
+public:
+    using value_type = char;
+    using flag_type = regex_constants::syntax_option_type;
+
+    static constexpr flag_type ECMAScript = regex_constants::ECMAScript;
+    static constexpr flag_type nosubs = regex_constants::nosubs;
+    static constexpr flag_type optimize = regex_constants::optimize;
+
+    // Matches nothing
+    regex() = default;
+
+    explicit regex(const char *p, flag_type f = ECMAScript) : regex(std::string(p), f) {}
+    regex(const char *p, std::size_t len, flag_type f = ECMAScript) : regex(std::string(p, len), f) {}
+    explicit regex(const std::string &p, flag_type f = ECMAScript) : pattern_(p), flags_(f) { compile(); }
+
+    // Copies compile the pattern again, as a tre_comp cannot be copied
+    regex(const regex &other) : pattern_(other.pattern_), flags_(other.flags_)
+    {
+        if (other.search_ || other.any_)
+            compile();
+    }
+
+    regex &operator=(const regex &other)
+    {
+        if (this != &other)
+            *this = regex(other);
+        return *this;
+    }
+
+    regex(regex &&) = default;
+    regex &operator=(regex &&) = default;
+
+    flag_type flags() const noexcept { return flags_; }
+    unsigned mark_count() const noexcept { return 0; }
+
+    // Leftmost match in [first, last), or null
+    const char *search(const char *first, const char *last, const char **end) const
+    {
+        std::optional<std::string_view> m;
+
+        if (first == last || any_)
+            return nullable_ ? (*end = first) : nullptr;
+        if (search_)
+            m = search_->search(std::string_view(first, static_cast<std::size_t>(last - first)));
+        if (!m)
+            return nullptr;
+        *end = m->data() + m->size();
+        return m->data();
+    }
+
+    // Does all of [first, last) match
+    bool match(const char *first, const char *last) const
+    {
+        if (first == last || any_)
+            return nullable_ && first == last;
+        return full_ && full_->search(std::string_view(first, static_cast<std::size_t>(last - first)));
+    }
+
+private:
+    void compile()
+    {
+        const flag_type grammar = regex_constants::basic | regex_constants::extended | regex_constants::awk |
+                                  regex_constants::grep | regex_constants::egrep;
+        const std::size_t n = pattern_.size();
+        std::string full;
+        std::size_t i, k, nodes = 0;
+        unsigned long min, max;
+        bool inclass = false, quant = false, ok;
+
+        if (flags_ & grammar)
+            throw unsupported_error("tre_std::regex: only the ECMAScript grammar is supported");
+        if (flags_ & regex_constants::icase)
+            throw unsupported_error("tre_std::regex: icase is not supported");
+        if (flags_ & regex_constants::collate)
+            throw unsupported_error("tre_std::regex: collate is not supported");
+        if (flags_ & regex_constants::multiline)
+            throw unsupported_error("tre_std::regex: multiline is not supported");
+
+        // Checks re.h does not make, and the nodes of the pattern, quant if the last is a quantifier
+        for (i = 0; i < n; i++)
+        {
+            const char c = pattern_[i];
+            if (c == '\\')
+            {
+                if (++i == n)
+                    throw std::regex_error(regex_constants::error_escape);
+                const char e = pattern_[i];
+                if ((e >= 'a' && e <= 'z') || (e >= 'A' && e <= 'Z') || (e >= '0' && e <= '9'))
+                {
+                    if (!std::strchr("sSwWdD", e))
+                        throw unsupported_error("tre_std::regex: escapes other than \\s \\S \\w \\W \\d \\D "
+                                                "and punctuation are not supported");
+                }
+                nodes += !inclass;
+                quant = false;
+            }
+            else if (inclass)
+                inclass = c != ']';
+            else if (c == '[')
+            {
+                inclass = true;
+                nodes++;
+                quant = false;
+            }
+            else if (c == '|')
+                throw unsupported_error("tre_std::regex: alternation '|' is not supported");
+            else if (c == '(' || c == ')')
+                throw unsupported_error("tre_std::regex: groups are not supported");
+            else if ((c == '^' && i) || (c == '$' && i + 1 != n))
+                throw unsupported_error("tre_std::regex: '^' and '$' only anchor the whole pattern");
+            else if (c == '?' && quant)
+                quant = false; // lazy, in the node of the quantifier
+            else if (c == '{')
+            {
+                // std::regex takes counts of any size, re.h up to TRE_MAXQUANT
+                k = i + 1;
+                ok = number(k, min);
+                max = min;
+                if (ok && k < n && pattern_[k] == ',' && ++k < n && pattern_[k] != '}')
+                    ok = number(k, max);
+                if (k == n)
+                    throw std::regex_error(regex_constants::error_brace);
+                if (!ok || pattern_[k] != '}' || max < min)
+                    throw std::regex_error(regex_constants::error_badbrace);
+                if (max > TRE_MAXQUANT)
+                    throw unsupported_error("tre_std::regex: counts in {m,n} past 1024 are not supported");
+                i = k;
+                nodes++;
+                quant = true;
+            }
+            else
+            {
+                nodes++;
+                quant = c == '*' || c == '+' || c == '?';
+            }
+        }
+
+        // re.h refuses the empty pattern, which has an empty match anywhere
+        if (!n)
+        {
+            any_ = nullable_ = true;
+            return;
+        }
+
+        full = (pattern_.compare(0, 1, "^") ? "^" : "") + pattern_;
+        // A '$' after an odd number of backslashes is a literal one
+        for (k = 0; k + 1 < full.size() && full[full.size() - 2 - k] == '\\'; k++) {}
+        if (full.size() < 2 || full.back() != '$' || k % 2)
+            full += '$';
+        // Each anchor added for regex_match is a node as well
+        if (nodes + (full.size() - n) > TRE_MAX_NODES - 1)
+            throw unsupported_error("tre_std::regex: patterns of more nodes than a tre_comp holds are not supported");
+
+        try
+        {
+            search_.emplace(pattern_);
+            full_.emplace(full);
+        }
+        catch (const tre::regex_error &)
+        {
+            search_.reset();
+            throw std::regex_error(inclass ? regex_constants::error_brack : regex_constants::error_badrepeat);
+        }
+        nullable_ = tre_nullable(&search_->comp());
+    }
+
+    // Number in pattern_ at i, moving i past its digits. False if there are none.
+    bool number(std::size_t &i, unsigned long &v) const
+    {
+        const std::size_t from = i;
+        for (v = 0; i < pattern_.size() && pattern_[i] >= '0' && pattern_[i] <= '9'; i++)
+            v = std::min(10 * v + static_cast<unsigned long>(pattern_[i] - '0'), 10ul * TRE_MAXQUANT);
+        return i != from;
+    }
+
+    std::string pattern_;
+    flag_type flags_ = ECMAScript;
+    std::optional<tre::regex> search_; // the pattern
+    std::optional<tre::regex> full_;   // and anchored at both ends
+    bool any_ = false;                  // the empty pattern
+    bool nullable_ = false;
+};
+
+template <class BidirIt>
+class match_results
+{
+public:
+    using value_type = std::sub_match<BidirIt>;
+    using const_reference = const value_type &;
+    using reference = value_type &;
+    using const_iterator = const value_type *;
+    using iterator = const_iterator;
+    using difference_type = typename std::iterator_traits<BidirIt>::difference_type;
+    using size_type = std::size_t;
+    using char_type = typename std::iterator_traits<BidirIt>::value_type;
+    using string_type = std::basic_string<char_type>;
+
+    bool ready() const noexcept { return ready_; }
+    bool empty() const noexcept { return !matched_; }
+    size_type size() const noexcept { return matched_ ? 1 : 0; }
+    size_type max_size() const noexcept { return 1; }
+
+    const_reference operator[](size_type n) const { return n == 0 && matched_ ? sub_[0] : unmatched_; }
+    const_reference prefix() const { return sub_[1]; }
+    const_reference suffix() const { return sub_[2]; }
+    difference_type length(size_type n = 0) const { return (*this)[n].length(); }
+    difference_type position(size_type n = 0) const { return std::distance(begin_, (*this)[n].first); }
+    string_type str(size_type n = 0) const { return (*this)[n].str(); }
+
+    const_iterator begin() const noexcept { return sub_; }
+    const_iterator end() const noexcept { return sub_ + size(); }
+    const_iterator cbegin() const noexcept { return begin(); }
+    const_iterator cend() const noexcept { return end(); }
+
+    // Set by regex_search and regex_match: no match, or one from first to last in [begin, end)
+    void assign(BidirIt begin, BidirIt end, BidirIt first, BidirIt last, bool matched)
+    {
+        ready_ = true;
+        matched_ = matched;
+        begin_ = begin;
+        unmatched_ = value_type();
+        unmatched_.first = unmatched_.second = end;
+        sub_[0] = sub_[1] = sub_[2] = unmatched_;
+        if (!matched)
+            return;
+        sub_[0].first = first;
+        sub_[0].second = last;
+        sub_[0].matched = true;
+        sub_[1].first = begin;
+        sub_[1].second = first;
+        sub_[1].matched = first != begin;
+        sub_[2].first = last;
+        sub_[2].second = end;
+        sub_[2].matched = last != end;
+    }
+
+private:
+    value_type sub_[3];   // match, prefix and suffix
+    value_type unmatched_;
+    BidirIt begin_{};
+    bool ready_ = false;
+    bool matched_ = false;
+};
+
+using cmatch = match_results<const char *>;
+using smatch = match_results<std::string::const_iterator>;
+
+namespace detail
+{
+
+// The text of [first, last) as chars in a row, as re.h reads them
+template <class BidirIt>
+const char *text(BidirIt first, BidirIt last)
+{
+    static_assert(std::is_same_v<BidirIt, const char *> || std::is_same_v<BidirIt, char *> ||
+                      std::is_same_v<BidirIt, std::string::const_iterator> ||
+                      std::is_same_v<BidirIt, std::string::iterator>,
+                  "tre_std: texts are const char * ranges or std::string iterators");
+    return (first == last) ? "" : &*first;
+}
+
+inline void flags(regex_constants::match_flag_type f)
+{
+    if (f != regex_constants::match_default)
+        throw unsupported_error("tre_std: match flags other than match_default are not supported");
+}
+
+} // namespace detail
+
+template <class BidirIt>
+bool regex_search(BidirIt first, BidirIt last, match_results<BidirIt> &m, const regex &e,
+                  regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    const char *text = detail::text(first, last), *end = nullptr;
+    const char *start;
+
+    detail::flags(f);
+    start = e.search(text, text + std::distance(first, last), &end);
+    if (!start)
+    {
+        m.assign(first, last, last, last, false);
+        return false;
+    }
+    m.assign(first, last, std::next(first, start - text), std::next(first, end - text), true);
+    return true;
+}
+
+template <class BidirIt>
+bool regex_search(BidirIt first, BidirIt last, const regex &e,
+                  regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    const char *text = detail::text(first, last), *end;
+    detail::flags(f);
+    return e.search(text, text + std::distance(first, last), &end) != nullptr;
+}
+
+inline bool regex_search(const char *s, cmatch &m, const regex &e,
+                         regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    return regex_search(s, s + std::strlen(s), m, e, f);
+}
+
+inline bool regex_search(const char *s, const regex &e,
+                         regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    return regex_search(s, s + std::strlen(s), e, f);
+}
+
+inline bool regex_search(const std::string &s, smatch &m, const regex &e,
+                         regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    return regex_search(s.begin(), s.end(), m, e, f);
+}
+
+inline bool regex_search(const std::string &s, const regex &e,
+                         regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    return regex_search(s.begin(), s.end(), e, f);
+}
+
+bool regex_search(const std::string &&, smatch &, const regex &,
+                  regex_constants::match_flag_type = regex_constants::match_default) = delete;
+
+template <class BidirIt>
+bool regex_match(BidirIt first, BidirIt last, match_results<BidirIt> &m, const regex &e,
+                 regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    const char *text = detail::text(first, last);
+    const bool matched = (detail::flags(f), e.match(text, text + std::distance(first, last)));
+
+    m.assign(first, last, matched ? first : last, last, matched);
+    return matched;
+}
+
+template <class BidirIt>
+bool regex_match(BidirIt first, BidirIt last, const regex &e,
+                 regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    const char *text = detail::text(first, last);
+    detail::flags(f);
+    return e.match(text, text + std::distance(first, last));
+}
+
+inline bool regex_match(const char *s, cmatch &m, const regex &e,
+                        regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    return regex_match(s, s + std::strlen(s), m, e, f);
+}
+
+inline bool regex_match(const char *s, const regex &e,
+                        regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    return regex_match(s, s + std::strlen(s), e, f);
+}
+
+inline bool regex_match(const std::string &s, smatch &m, const regex &e,
+                        regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    return regex_match(s.begin(), s.end(), m, e, f);
+}
+
+inline bool regex_match(const std::string &s, const regex &e,
+                        regex_constants::match_flag_type f = regex_constants::match_default)
+{
+    return regex_match(s.begin(), s.end(), e, f);
+}
+
+bool regex_match(const std::string &&, smatch &, const regex &,
+                 regex_constants::match_flag_type = regex_constants::match_default) = delete;
+
+} // namespace tre_std
+
+#endif // TRE_RE_STD_HPP_INCLUDE
@@ -0,0 +1,88 @@
+/*
+ * SQLite loadable extension adding regexp(pattern, text), which SQLite calls
+ * for "text REGEXP pattern", over re.h.
+ *
+ *   .load ./sqlite/tre_regexp
+ *   SELECT count(*) FROM log WHERE line REGEXP '\d+ms';
+ *
+ * The pattern is compiled once per statement and kept with
+ * sqlite3_set_auxdata for the following rows. Texts are passed with their
+ * length, never measured with strlen. A NULL pattern or text gives NULL, and
+ * the empty pattern, which re.h does not compile, matches every text.
+ */
+
+#include <sqlite3ext.h>
+SQLITE_EXTENSION_INIT1
+#define TRE_SILENT // errors are reported through sqlite3_result_error
+#define TRE_IMPLEMENTATION
+#include "re.h"
+
+
+#define TRE_SQL_SCRATCH 16384 // bytes of lazy DFA cache per compiled pattern
+
+#ifndef SQLITE_INNOCUOUS
+#define SQLITE_INNOCUOUS 0 // SQLite before 3.31
+#endif
+
+// Compiled pattern of a statement
+typedef struct
+{
+    tre_comp tregex;
+    int any;                             // the empty pattern, matching every text
+    int nullable;                        // matches the empty text
+    unsigned char mem[TRE_SQL_SCRATCH];  // scratch, as a statement runs on one thread
+} tre_regexp;
+
+static void regexpfunc(sqlite3_context *ctx, int argc, sqlite3_value **argv)
+{
+    tre_regexp *re = sqlite3_get_auxdata(ctx, 0);
+    const char *pattern, *text, *end;
+    int plen, tlen, fresh = 0;
+
+    (void)argc;
+    if (sqlite3_value_type(argv[0]) == SQLITE_NULL || sqlite3_value_type(argv[1]) == SQLITE_NULL)
+        return;
+    if (!re)
+    {
+        pattern = (const char *)sqlite3_value_text(argv[0]);
+        plen = sqlite3_value_bytes(argv[0]);
+        if (!pattern || !(re = sqlite3_malloc(sizeof(*re))))
+        {
+            sqlite3_result_error_nomem(ctx);
+            return;
+        }
+        re->any = !plen;
+        if (!re->any && !tre_ncompile(pattern, (size_t)plen, &re->tregex))
+        {
+            sqlite3_free(re);
+            sqlite3_result_error(ctx, "regexp: pattern does not compile", -1);
+            return;
+        }
+        re->nullable = re->any || tre_nullable(&re->tregex);
+        fresh = 1;
+    }
+
+    text = (const char *)sqlite3_value_text(argv[1]);
+    tlen = sqlite3_value_bytes(argv[1]);
+    if (!text)
+        sqlite3_result_error_nomem(ctx);
+    else if (!tlen || re->any)
+        sqlite3_result_int(ctx, re->nullable);
+    else
+        sqlite3_result_int(ctx, tre_nmatch_mem(&re->tregex, text, (size_t)tlen, &end, re->mem, sizeof(re->mem)) != 0);
+
+    // Kept for the next rows while the pattern stays the same, else freed by SQLite
+    if (fresh)
+        sqlite3_set_auxdata(ctx, 0, re, sqlite3_free);
+}
+
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+int sqlite3_treregexp_init(sqlite3 *db, char **errmsg, const sqlite3_api_routines *api)
+{
+    (void)errmsg;
+    SQLITE_EXTENSION_INIT2(api);
+    return sqlite3_create_function(db, "regexp", 2, SQLITE_UTF8 | SQLITE_DETERMINISTIC | SQLITE_INNOCUOUS, 0,
+                                   regexpfunc, 0, 0);
+}
@@ -0,0 +1,117 @@
+/*
+ * Throughput on multi-gigabyte texts. A file of log lines is mapped over and
+ * over into one contiguous range of 8 GiB, or of the MiB given on the command
+ * line, so little memory is needed. The last copy is mapped privately and gets
+ * a needle near its end, past 4 GiB in the full run.
+ */
+
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "re.h"
+
+
+#define CHUNK   ((size_t)64 << 20)
+#define LONGRUN 100000 // bytes of the long line, past the old 40000 limit of '*'
+#define NEEDLE  "needle=4242\n"
+
+static const char *lines[] =
+{
+    "2024-05-01 12:34:56 INFO  GET /api/v1/items/1234 200 12ms id=4f3a9c2e\n",
+    "2024-05-01 12:34:57 WARN  slow query on orders (342ms) user=alice\n",
+    "2024-05-01 12:34:58 DEBUG cache hit key=session:9f8e7d6c ttl=300\n",
+};
+
+// Patterns, what they find: the needle, the long line or nothing
+enum { NEEDLE_AT, LONG_AT, NONE };
+static struct { const char *pattern; int want; } tests[] =
+{
+    { "needle=\\d+",                NEEDLE_AT }, // literal search
+    { "long:z*!",                   LONG_AT   }, // literal, then a run as long as the line
+    { "\\d{4}-\\d\\d-\\d\\dX",      NONE      }, // fixed width
+    { "[xq]\\w+[#%]",               NONE      }, // Shift-And
+    { "ERROR\\s+\\w+ timeout",      NONE      }, // literal missing
+};
+
+static unsigned char scratch[1 << 16]; // lazy DFA cache
+
+static char *fillchunk(FILE *f)
+{
+    char *buf = malloc(CHUNK), *p = buf;
+    size_t i = 0, n;
+
+    memcpy(p, "long:", 5);
+    memset(p + 5, 'z', LONGRUN - 7);
+    memcpy(p + LONGRUN - 2, "!\n", 2);
+    for (p += LONGRUN; (n = strlen(lines[i % 3])) <= (size_t)(buf + CHUNK - p); i++, p += n)
+        memcpy(p, lines[i % 3], n);
+    memset(p, '\n', buf + CHUNK - p);
+    if (fwrite(buf, 1, CHUNK, f) != CHUNK || fflush(f))
+        return 0;
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = (argc > 1 ? strtoull(argv[1], 0, 10) : 8192) << 20, off, want;
+    const char *m, *e;
+    char *base, *buf;
+    FILE *f = tmpfile();
+    double secs;
+    clock_t t;
+    size_t i;
+    int failed = 0;
+    tre_comp tregex;
+
+    size -= size % CHUNK;
+    if (!f || !size || !(buf = fillchunk(f)))
+    {
+        fprintf(stderr, "cannot set up %lu bytes of text\n", (unsigned long)size);
+        return 1;
+    }
+    base = mmap(0, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    for (off = 0; base != MAP_FAILED && off < size; off += CHUNK)
+    {
+        if (mmap(base + off, CHUNK, off + CHUNK < size ? PROT_READ : PROT_READ | PROT_WRITE,
+                 (off + CHUNK < size ? MAP_SHARED : MAP_PRIVATE) | MAP_FIXED, fileno(f), 0) == MAP_FAILED)
+            base = MAP_FAILED;
+    }
+    if (base == MAP_FAILED)
+    {
+        perror("mmap");
+        return 1;
+    }
+    memcpy(base + size - 64, NEEDLE, strlen(NEEDLE));
+
+    printf("Matching %lu MiB of log lines:\n", (unsigned long)(size >> 20));
+    for (i = 0; i < sizeof(tests) / sizeof(*tests); i++)
+    {
+        tre_compile(tests[i].pattern, &tregex);
+        t = clock();
+        m = tre_nmatch_mem(&tregex, base, size, &e, scratch, sizeof(scratch));
+        secs = (double)(clock() - t) / CLOCKS_PER_SEC;
+        off = m ? (size_t)(e - base) : 0;
+
+        want = tests[i].want == NEEDLE_AT ? size - 64 : 0;
+        if ((tests[i].want == NONE) != !m || (m && (size_t)(m - base) != want) ||
+            (tests[i].want == LONG_AT && off != LONGRUN - 1))
+        {
+            printf("  pattern '%s': wrong match [%ld,%ld]\n", tests[i].pattern,
+                   m ? (long)(m - base) : -1L, m ? (long)off : -1L);
+            failed = 1;
+            continue;
+        }
+        // A miss reads it all, a match up to its end
+        printf("  pattern %-26s %8.3f s %8.2f GB/s\n", tests[i].pattern, secs,
+               (double)(m ? off : size) / 1e9 / (secs > 0 ? secs : 1e-9));
+    }
+
+    munmap(base, size);
+    free(buf);
+    fclose(f);
+    return failed;
+}
@@ -0,0 +1,131 @@
+/*
+ * REGEXP queries over a table of a million log lines, or of the rows given
+ * on the command line, with the extension in sqlite/. Each query is also run
+ * with the pattern from an expression over the row, which SQLite keeps no
+ * auxdata for, to show what compiling once per statement saves. Counts are
+ * checked against the lines put in.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sqlite3.h>
+
+
+static const char *lines[] =
+{
+    "2024-05-01 12:34:56 INFO  GET /api/v1/items/%d 200 12ms id=4f3a9c2e",
+    "2024-05-01 12:34:57 WARN  slow query on orders (%dms) user=alice",
+    "2024-05-01 12:34:58 DEBUG cache hit key=session:%d ttl=300",
+    "2024-05-01 12:34:59 ERROR upstream timeout after %dms host=10.0.3.17",
+};
+
+// Queries, with a ? for the pattern, and the kinds of lines they find
+static struct { const char *sql; const char *pattern; int want[4]; } tests[] =
+{
+    { "SELECT count(*) FROM log WHERE line LIKE ?",                      "%ERROR%",                    { 0, 0, 0, 1 } },
+    { "SELECT count(*) FROM log WHERE line REGEXP ?",                    "ERROR",                      { 0, 0, 0, 1 } },
+    { "SELECT count(*) FROM log WHERE regexp(iif(rowid, ?, 0), line)",   "ERROR",                      { 0, 0, 0, 1 } },
+    { "SELECT count(*) FROM log WHERE line REGEXP ?",                    "\\d+ms",                     { 1, 1, 0, 1 } },
+    { "SELECT count(*) FROM log WHERE regexp(iif(rowid, ?, 0), line)",   "\\d+ms",                     { 1, 1, 0, 1 } },
+    { "SELECT count(*) FROM log WHERE line REGEXP ?",                    "\\d+\\.\\d+\\.\\d+\\.\\d+$", { 0, 0, 0, 1 } },
+    { "SELECT count(*) FROM log WHERE regexp(iif(rowid, ?, 0), line)",   "\\d+\\.\\d+\\.\\d+\\.\\d+$", { 0, 0, 0, 1 } },
+};
+
+static int run(sqlite3 *db, const char *sql)
+{
+    char *err = 0;
+
+    if (sqlite3_exec(db, sql, 0, 0, &err) != SQLITE_OK)
+    {
+        fprintf(stderr, "%s: %s\n", sql, err);
+        sqlite3_free(err);
+        return 0;
+    }
+    return 1;
+}
+
+// First column of the first row of sql with pattern bound to its ?, or -1
+static long query(sqlite3 *db, const char *sql, const char *pattern)
+{
+    sqlite3_stmt *stmt;
+    long n = -1;
+
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, 0) != SQLITE_OK)
+        return -1;
+    sqlite3_bind_text(stmt, 1, pattern, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) == SQLITE_ROW)
+        n = (long)sqlite3_column_int64(stmt, 0);
+    sqlite3_finalize(stmt);
+    return n;
+}
+
+int main(int argc, char **argv)
+{
+    const long nrows = argc > 1 ? strtol(argv[1], 0, 10) : 1000000;
+    sqlite3_stmt *stmt;
+    sqlite3 *db;
+    char *err = 0, line[128], toolong[72];
+    long i, want, got;
+    double secs;
+    clock_t t;
+    size_t k;
+    int j, failed = 0;
+
+    if (sqlite3_open(":memory:", &db) != SQLITE_OK || sqlite3_enable_load_extension(db, 1) != SQLITE_OK ||
+        sqlite3_load_extension(db, "./sqlite/tre_regexp", 0, &err) != SQLITE_OK)
+    {
+        fprintf(stderr, "cannot load the extension: %s\n", err ? err : sqlite3_errmsg(db));
+        return 1;
+    }
+
+    // NULLs, empty texts and patterns, and patterns that do not compile, as one of too many nodes
+    memset(toolong, 'a', 70);
+    toolong[70] = 'b';
+    toolong[71] = 0;
+    if (query(db, "SELECT (NULL REGEXP 'a') IS NULL AND ('a' REGEXP ?) IS NULL AND '' REGEXP 'a*' AND "
+                  "NOT '' REGEXP 'a' AND 'x9ms' REGEXP '\\d+ms' AND '' REGEXP '' AND 'x' REGEXP ''", 0) != 1 ||
+        query(db, "SELECT 'a' REGEXP 'a{2,1}'", 0) != -1 || query(db, "SELECT 'aaa' REGEXP ?", toolong) != -1)
+    {
+        fprintf(stderr, "wrong result for NULL, empty text or pattern, or a pattern that does not compile\n");
+        return 1;
+    }
+
+    if (!run(db, "CREATE TABLE log (line TEXT); BEGIN") ||
+        sqlite3_prepare_v2(db, "INSERT INTO log VALUES (?)", -1, &stmt, 0) != SQLITE_OK)
+        return 1;
+    for (i = 0; i < nrows; i++)
+    {
+        j = snprintf(line, sizeof(line), lines[i % 4], (int)(i % 100000));
+        sqlite3_bind_text(stmt, 1, line, j, SQLITE_TRANSIENT);
+        if (sqlite3_step(stmt) != SQLITE_DONE)
+            return 1;
+        sqlite3_reset(stmt);
+    }
+    sqlite3_finalize(stmt);
+    if (!run(db, "COMMIT"))
+        return 1;
+
+    printf("Querying %ld rows of log lines:\n", nrows);
+    for (k = 0; k < sizeof(tests) / sizeof(*tests); k++)
+    {
+        t = clock();
+        got = query(db, tests[k].sql, tests[k].pattern);
+        secs = (double)(clock() - t) / CLOCKS_PER_SEC;
+
+        for (want = 0, j = 0; j < 4; j++)
+            want += tests[k].want[j] ? nrows / 4 + (j < nrows % 4) : 0;
+        if (got != want)
+        {
+            printf("  %s with '%s': %ld rows, not %ld\n", tests[k].sql, tests[k].pattern, got, want);
+            failed = 1;
+            continue;
+        }
+        printf("  %-32s %-24s %8.3f s %8.1f ns/row\n", tests[k].sql + 31, tests[k].pattern, secs,
+               secs * 1e9 / (nrows ? nrows : 1));
+    }
+
+    sqlite3_close(db);
+    return failed;
+}
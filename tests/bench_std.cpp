@@ -0,0 +1,87 @@
+/*
+ * Migrating from std::regex: the same regex_search calls over log lines with
+ * std::regex and with tre_std from re_std.hpp, one line at a time as a log
+ * scanner would. Both must find the same matches. Lines are repeated up to
+ * the count given on the command line, 200000 by default.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <regex>
+#include <string>
+#include <vector>
+#include "re_std.hpp"
+
+
+static const char *lines[] =
+{
+    "2024-05-01 12:34:56 INFO  GET /api/v1/items/1234 200 12ms id=4f3a9c2e",
+    "2024-05-01 12:34:57 WARN  slow query on orders (342ms) user=alice",
+    "2024-05-01 12:34:58 DEBUG cache hit key=session:9f8e7d6c ttl=300",
+    "2024-05-01 12:34:59 ERROR upstream timeout after 30000ms host=10.0.3.17",
+};
+
+static const char *patterns[] =
+{
+    "ERROR",                         // literal
+    "\\d+ms",                        // digits, then a literal
+    "user=\\w+$",                    // anchored at the end
+    "^\\d{4}-\\d\\d-\\d\\d \\d\\d",  // fixed width at the start
+    "[a-f0-9]{8}",                   // hex id
+    "\\d+\\.\\d+\\.\\d+\\.\\d+",     // IPv4 address
+};
+
+// Sum of 1 + position + length over the matches in text, and the seconds it took
+template <class Regex, class Match, class Search>
+static double run(const std::vector<std::string> &text, const Regex &re, Search search, std::size_t *found)
+{
+    const auto t = std::chrono::steady_clock::now();
+    Match m;
+
+    *found = 0;
+    for (const std::string &line : text)
+        if (search(line, m, re))
+            *found += static_cast<std::size_t>(1 + m.position() + m.length());
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t).count();
+}
+
+int main(int argc, char **argv)
+{
+    const std::size_t n = argc > 1 ? std::strtoull(argv[1], 0, 10) : 200000;
+    std::vector<std::string> text;
+    std::size_t i, sfound, tfound;
+    double ssecs, tsecs;
+    int failed = 0;
+
+    for (i = 0; i < n; i++)
+        text.emplace_back(lines[i % (sizeof(lines) / sizeof(*lines))]);
+
+    std::printf("Searching %lu log lines, std::regex against tre_std:\n", (unsigned long)n);
+    for (i = 0; i < sizeof(patterns) / sizeof(*patterns); i++)
+    {
+        const std::regex sre(patterns[i]);
+        const tre_std::regex tre(patterns[i]);
+
+        ssecs = run<std::regex, std::smatch>(
+            text, sre,
+            [](const std::string &s, std::smatch &m, const std::regex &e) { return std::regex_search(s, m, e); },
+            &sfound);
+        tsecs = run<tre_std::regex, tre_std::smatch>(
+            text, tre,
+            [](const std::string &s, tre_std::smatch &m, const tre_std::regex &e)
+            { return tre_std::regex_search(s, m, e); },
+            &tfound);
+
+        if (sfound != tfound)
+        {
+            std::printf("  pattern '%s': %lu against %lu\n", patterns[i], (unsigned long)sfound,
+                        (unsigned long)tfound);
+            failed = 1;
+            continue;
+        }
+        std::printf("  pattern %-28s std %8.1f ns/line  tre_std %8.1f ns/line  %6.1fx\n", patterns[i],
+                    ssecs * 1e9 / n, tsecs * 1e9 / n, ssecs / (tsecs > 0 ? tsecs : 1e-9));
+    }
+    return failed;
+}
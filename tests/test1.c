@@ -89,9 +89,29 @@ char* test_vector[][3] =
   { NOK, "X?Y",                        "Z"               },
   { OK, ".?jjsj",                    "jjsj"            },
   {NOK, "[a-z].[A-Z]", "y\nL" },
+  { OK,  "caf\xc3\xa9",             "un caf\xc3\xa9"  },
+  { NOK, "caf\xc3\xa9",             "un cafe"          },
+  { OK,  "[\xc3\xa9]+$",            "caf\xc3\xa9"     },
+  { OK,  "[\x80-\xff]",             "na\xefve"         },
+  { NOK, "[\x80-\xff]",             "naive"            },
+  { OK,  "[^\x80-\xff]+$",          "\xefx"            },
+  { OK,  "[a-\xff]+$",              "caf\xc3\xa9"     },
+  { NOK, "[\xe0-\xff]",             "caf\xc3\xa9"     },
+  { OK,  "a.*[xy]z",                 "axz bxq cc"       },
+  { OK,  "a.*\\d$",                  "a1b2cc3"          },
+  { OK,  "a.*b$",                    "aXbYb"            },
+  { OK,  "a.{2,}b",                  "abbb"             },
+  { NOK, "a.{3,}b",                  "abbb"             },
+  { NOK, "a.*b",                     "a\nb"             },
+  { NOK, ".*\\d[xz]",                "a1b2c"            },
+  { NOK, "x.*\\d",                   "xabc"             },
+  { NOK, "a.*b",                     "accccc"           },
 
 };
 
+// Patterns with a range running backwards, which tre_compile refuses
+char* bad_pattern[] = { "[z-a]", "[\xff-a]", "[\x80-\x7f]" };
+
 
 int main()
 {
@@ -99,6 +119,7 @@ int main()
     char* pattern;
     int should_fail;
     size_t ntests = sizeof(test_vector) / sizeof(*test_vector);
+    size_t nbad = sizeof(bad_pattern) / sizeof(*bad_pattern);
     size_t nfailed = 0;
     size_t i;
     tre_comp tregex;
@@ -119,6 +140,14 @@ int main()
         }
         const char *m = tre_match(&tregex, text, NULL);
 
+        // With the length known, patterns like 'a.*b' are backtracked first
+        if (*text && !m != !tre_nmatch(&tregex, text, strlen(text), NULL))
+        {
+            fprintf(stderr, "[%lu/%lu]: pattern '%s' on '%s': tre_nmatch and tre_match disagree. \n", (i+1), ntests, pattern, text);
+            nfailed += 1;
+            continue;
+        }
+
         if (should_fail)
         {
             if (m)
@@ -141,6 +170,16 @@ int main()
         }
     }
 
+    for (i = 0; i < nbad; ++i)
+    {
+        if (tre_compile(bad_pattern[i], &tregex))
+        {
+            fprintf(stderr, "[%lu/%lu]: pattern '%s' compiled unexpectedly. \n", (ntests+i+1), ntests+nbad, bad_pattern[i]);
+            nfailed += 1;
+        }
+    }
+    ntests += nbad;
+
     // printf("\n");
     printf("%lu/%lu tests succeeded.\n", ntests - nfailed, ntests);
     printf("\n");
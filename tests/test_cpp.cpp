@@ -0,0 +1,287 @@
+/*
+ * Testing the C++ interface of re.hpp: compiling into pmr memory, moving,
+ * searching string_views and iterating over matches without allocating.
+ * Then the std::regex look-alike of re_std.hpp against std::regex itself.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <new>
+#include <regex>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "re.hpp"
+#include "re_std.hpp"
+
+
+static std::size_t nalloc; // calls of operator new
+
+// Not inlined into callers, where GCC would take the free for a mismatch
+#if defined(__GNUC__)
+#define TEST_NOINLINE __attribute__((noinline))
+#else
+#define TEST_NOINLINE
+#endif
+
+TEST_NOINLINE void *operator new(std::size_t size)
+{
+    nalloc++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+TEST_NOINLINE void operator delete(void *p) noexcept { std::free(p); }
+TEST_NOINLINE void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+static std::size_t ntests, nfailed;
+
+static void check(bool ok, const char *what)
+{
+    ntests++;
+    if (!ok)
+    {
+        nfailed++;
+        std::fprintf(stderr, "failed: %s\n", what);
+    }
+}
+
+// Matches of pattern in text, joined by '|'
+static std::string all(const tre::regex &re, std::string_view text)
+{
+    std::string s;
+    for (std::string_view m : re.find_all(text))
+        s.append(m).append("|");
+    return s;
+}
+
+// Same search and full match as std::regex for each text
+static bool samestd(const char *pattern, const char *const *texts)
+{
+    const std::regex sre(pattern);
+    const tre_std::regex tre(pattern);
+    std::cmatch sm;
+    tre_std::cmatch tm;
+
+    for (; *texts; texts++)
+    {
+        const char *t = *texts;
+        const bool found = std::regex_search(t, sm, sre);
+        if (tre_std::regex_search(t, tm, tre) != found || tm.size() != sm.size())
+            return false;
+        if (found && (tm.position() != sm.position() || tm.length() != sm.length() ||
+                      tm.prefix().str() != sm.prefix().str() || tm.suffix().str() != sm.suffix().str()))
+            return false;
+        if (tre_std::regex_match(t, tre) != std::regex_match(t, sre))
+            return false;
+    }
+    return true;
+}
+
+// Does pattern throw tre_std::unsupported_error
+static bool unsupported(const char *pattern, tre_std::regex::flag_type f = tre_std::regex::ECMAScript)
+{
+    try
+    {
+        tre_std::regex re(pattern, f);
+    }
+    catch (const tre_std::unsupported_error &e)
+    {
+        return std::string_view(e.what()).find("not supported") != std::string_view::npos ||
+               std::string_view(e.what()).find("only") != std::string_view::npos;
+    }
+    return false;
+}
+
+// Does pattern throw a std::regex_error of code want
+static bool fails(const char *pattern, std::regex_constants::error_type want)
+{
+    try
+    {
+        tre_std::regex re(pattern);
+    }
+    catch (const std::regex_error &e)
+    {
+        return e.code() == want;
+    }
+    return false;
+}
+
+int main()
+{
+    alignas(std::max_align_t) static unsigned char buf[8 * sizeof(tre_comp)];
+    std::pmr::monotonic_buffer_resource pool(buf, sizeof(buf), std::pmr::null_memory_resource());
+    const std::string text = "id=42 size=1024 name=x7";
+    std::size_t before, count;
+
+    // Compiled into the pool, which cannot grow
+    tre::regex digits("\\d+", &pool);
+    check(digits && digits.resource() == &pool, "regex compiled in a pmr pool");
+
+    // Views into a text that is not NUL-terminated
+    std::string_view view(text.data(), 8);
+    check(digits.search(view) == std::string_view("42"), "search in a string_view");
+    check(digits.search(view)->data() == text.data() + 3, "match points into the text");
+    check(!digits.search(std::string_view(text.data(), 3)), "no match in a prefix");
+    check(!digits.search(""), "no match in an empty text");
+    check(tre::regex("a*", &pool).search(std::string_view(text.data(), 0)) == std::string_view(text.data(), 0),
+          "an empty match in an empty text");
+
+    check(all(digits, text) == "42|1024|7|", "find_all over all matches");
+    check(all(tre::regex("^\\w+", &pool), text) == "id|", "a '^' pattern matches once");
+    check(all(tre::regex("x*", &pool), "ab") == "|||", "empty matches move on by a byte, to the end");
+    check(all(tre::regex("\\d*", &pool), "a1") == "|1||", "an empty match after the last byte");
+    check(all(tre::regex("q", &pool), text).empty(), "find_all without a match");
+
+    // Searching and iterating allocate nothing
+    before = nalloc;
+    count = 0;
+    for (int i = 0; i < 1000; i++)
+        for (std::string_view m : digits.find_all(text))
+            count += m.size();
+    check(nalloc == before && count == 7000, "no allocation per match");
+
+    // Move-only, leaving the source empty
+    tre::regex moved = std::move(digits);
+    check(moved && !digits && moved.search(text) == std::string_view("42"), "move construction");
+    digits = std::move(moved);
+    check(digits && !moved && digits.search(text) == std::string_view("42"), "move assignment");
+
+    // The empty pattern matches every text, as in the Python and SQLite bindings
+    tre::regex empty("", &pool);
+    check(empty && empty.search("abc") == std::string_view() && empty.search("abc")->data() != nullptr &&
+              empty.search("") && all(empty, "ab") == "|||",
+          "the empty pattern");
+
+    // Allocator-aware: a pmr container hands its resource to the regexes in it
+    alignas(std::max_align_t) static unsigned char buf2[4 * sizeof(tre_comp)];
+    std::pmr::monotonic_buffer_resource pool2(buf2, sizeof(buf2), std::pmr::null_memory_resource());
+    std::pmr::vector<tre::regex> held(&pool2);
+    held.reserve(2);
+    held.emplace_back("a+b");
+    check(held[0].get_allocator().resource() == &pool2 && held[0].search("xaab") == std::string_view("aab"),
+          "uses-allocator construction in a pmr vector");
+    tre::regex stolen(std::move(held[0]), &pool2);
+    check(stolen && !held[0] && stolen.resource() == &pool2 && stolen.pattern() == "a+b",
+          "allocator-extended move from the same resource");
+    held[0] = tre::regex(std::move(stolen), &pool);
+    check(stolen && held[0].resource() == &pool && held[0].pattern() == "a+b" &&
+              held[0].search("xaab") == std::string_view("aab") && stolen.search("ab") == std::string_view("ab"),
+          "allocator-extended move to another resource compiles again");
+
+    bool thrown = false;
+    try
+    {
+        tre::regex bad("a{2,1}");
+    }
+    catch (const tre::regex_error &)
+    {
+        thrown = true;
+    }
+    check(thrown, "regex_error for a pattern that does not compile");
+
+    thrown = false;
+    try
+    {
+        tre::regex bad(std::string(70, 'a') + "b");
+    }
+    catch (const tre::regex_error &)
+    {
+        thrown = true;
+    }
+    check(thrown, "regex_error for a pattern of too many nodes");
+
+    // tre_std against std::regex
+    static const char *const texts[] = {"", "a", "aaa", "ab", "ba", "abab", "xaaby", "a1b22", " \t9x", "a\nb",
+                                        "id=42 size=1024", "aab.c", "{a}", "-+-", "a\\", "a$", "caf\xc3\xa9", 0};
+    static const char *const patterns[] = {"a", "a*", "a+", "a?", "^a", "a$", "^a*$", "ab", "a*b", "a+?b", "a*?",
+                                           "[ab]+", "[^a]", "\\d+", "\\w+\\s?", "\\s", "\\D\\d", "a{2}",
+                                           "a{1,2}b", ".", ".+", "\\.", "[a-c.]+", "\\{a\\}", "[-+]+", "^$",
+                                           "b*$", "=\\d+ ", "", "a\\\\$", "a\\$", "\xc3\xa9", "[\xc3\xa9]+", 0};
+    for (const char *const *p = patterns; *p; p++)
+    {
+        std::string what = std::string("same as std::regex: ") + *p;
+        check(samestd(*p, texts), what.c_str());
+    }
+
+    tre_std::smatch sm;
+    const std::string line = "GET /index.html 200";
+    const tre_std::regex status("\\d+$");
+    check(tre_std::regex_search(line, sm, status) && sm.str() == "200" && sm.position() == 16 &&
+              sm.prefix().str() == "GET /index.html " && !sm.suffix().matched && sm.ready(),
+          "smatch of a std::string");
+    check(!tre_std::regex_search(line, sm, tre_std::regex("q")) && sm.empty() && sm.ready() && !sm[0].matched,
+          "smatch without a match");
+    check(tre_std::regex_match(std::string("abc"), tre_std::regex("[a-c]+")) &&
+              !tre_std::regex_match(std::string("abcd"), tre_std::regex("[a-c]+")),
+          "regex_match of a std::string");
+
+    const std::string run(2000, 'a');
+    check(tre_std::regex_match(run, tre_std::regex("a{2,}")) &&
+              tre_std::regex_search(run, sm, tre_std::regex("a{3,}$")) && sm.length() == 2000,
+          "'{m,}' past 1024 bytes");
+
+    tre_std::regex copy = status, assigned;
+    check(!tre_std::regex_search("200", assigned), "a default regex matches nothing");
+    tre_std::cmatch cm;
+    assigned = tre_std::regex("");
+    check(tre_std::regex_search("200", cm, assigned) && cm.position() == 0 && cm.length() == 0 &&
+              !tre_std::regex_match("200", assigned),
+          "the empty pattern");
+    assigned = copy;
+    check(tre_std::regex_search("x 7", copy) && tre_std::regex_search("x 7", assigned), "copied regexes");
+
+    check(unsupported("a|b"), "unsupported alternation");
+    check(unsupported("(ab)+"), "unsupported groups");
+    check(unsupported("\\bword"), "unsupported word boundary");
+    check(unsupported("a\\n"), "unsupported newline escape");
+    check(unsupported("[\\t ]"), "unsupported escape in a class");
+    check(unsupported("a^b"), "unsupported '^' in the middle");
+    check(unsupported("a$b"), "unsupported '$' in the middle");
+    check(unsupported("a", tre_std::regex::ECMAScript | std::regex_constants::icase), "unsupported icase");
+    check(unsupported("a", std::regex_constants::extended), "unsupported grammar");
+    check(!unsupported("[|()^$]\\$"), "metacharacters in a class and escaped");
+    check(unsupported("a", tre_std::regex::ECMAScript | std::regex_constants::multiline), "unsupported multiline");
+    check(unsupported("a{2000}") && unsupported("a{2,2000}?") && unsupported("a{1025,}"),
+          "unsupported counts past 1024");
+    // 61 nodes, and the '^' and '$' regex_match adds, fill a tre_comp
+    const std::string longest = std::string(60, 'a') + "b";
+    check(unsupported((std::string(70, 'a') + "b").c_str()) && unsupported((longest + "b").c_str()) &&
+              unsupported(("^" + longest + "b$").c_str()) && !unsupported(("^" + longest + "$").c_str()) &&
+              tre_std::regex_match(longest, tre_std::regex(longest)) &&
+              !tre_std::regex_search(std::string(70, 'a'), tre_std::regex(longest)),
+          "unsupported patterns of too many nodes");
+    check(fails("a\\", std::regex_constants::error_escape) && fails("[a\\", std::regex_constants::error_escape),
+          "error_escape for a dangling backslash");
+    check(fails("a{2,1}", std::regex_constants::error_badbrace) && fails("a{x}", std::regex_constants::error_badbrace) &&
+              fails("a{2", std::regex_constants::error_brace),
+          "error_badbrace and error_brace for counts");
+
+    thrown = false;
+    try
+    {
+        tre_std::regex_search("a", tre_std::regex("a"), std::regex_constants::match_not_bol);
+    }
+    catch (const std::regex_error &)
+    {
+        thrown = true;
+    }
+    check(thrown, "unsupported match flags");
+
+    thrown = false;
+    try
+    {
+        tre_std::regex bad("[ab");
+    }
+    catch (const std::regex_error &e)
+    {
+        thrown = e.code() == std::regex_constants::error_brack;
+    }
+    check(thrown, "std::regex_error for a pattern that does not compile");
+
+    std::printf("%lu/%lu C++ tests succeeded.\n", (unsigned long)(ntests - nfailed), (unsigned long)ntests);
+    std::printf("\n");
+    return nfailed != 0;
+}
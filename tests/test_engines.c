@@ -0,0 +1,677 @@
+/*
+ * Cross-checks the match engines against the backtracking matcher on random
+ * patterns and texts. Includes the implementation to reach the engines.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define TRE_SILENT
+#define TRE_SETSCAN 8 // reach the tabulated scans with short texts
+#define TRE_LITSLACK 0 // and the literal search giving up
+#define TRE_SAFE_STEPS 1 // and the safe mode falling back
+#define TRE_IMPLEMENTATION
+#include "re.h"
+
+
+#ifndef NPATTERNS
+#define NPATTERNS 20000 // 'make test' builds with fewer, see NENGINE_TESTS
+#endif
+#define NTEXTS    20
+#define NFUZZY    2000
+#define NSETS     (NPATTERNS / 10)
+
+static const char *atoms[] = { "a", "b", "c", ".", "[ab]", "[^a]", "\\d", "\\w", "\\s", "[a-c1]", "\\D" };
+static const char *quants[] = { "", "", "", "?", "*", "+", "??", "*?", "+?", "{2}", "{1,3}", "{0,2}?", "{2,}",
+                                "{3,70}", "{0,30}", "{20,22}", "{4,}?", "{30,40}?" };
+static const char alphabet[] = "aabbc1 \n";
+
+#define COUNT(A) (sizeof(A) / sizeof(*(A)))
+
+typedef const char *(*engine_fn)(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                                 void *mem, size_t size);
+
+static unsigned char scratch[TRE_BITSTATE_BITS / 8];
+static unsigned char threadmem[TRE_BITSTATE_BITS / 8 + TRE_DFA_STATES * sizeof(tre_dstate) + 8];
+static tre_scratch safescratch;
+static uint32_t dfabuf[TRE_DFA_BUILDSIZE / 4 + 1], dfacopy[TRE_DFA_BUILDSIZE / 4 + 1];
+static const tre_dfa *eagerdfa; // of the pattern under test, if it has one
+
+static const char *onepass(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                           void *mem, size_t size)
+{
+    (void)mem; (void)size;
+    return matchonepass(tregex, text, tend, end);
+}
+
+static const char *fixed(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                         void *mem, size_t size)
+{
+    (void)mem; (void)size;
+    return matchfixed(tregex, text, tend, end, 0);
+}
+
+static const char *span(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                        void *mem, size_t size)
+{
+    (void)mem; (void)size;
+    return matchspan(tregex, text, tend, end);
+}
+
+// Backtracked first as matchtext does, scanned if the backtracker gives up
+static const char *jump(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                        void *mem, size_t size)
+{
+    const char *start;
+    if (tend && matchjump(tregex, text, tend, &start, end, mem, size))
+        return start;
+    return matchbits(tregex, text, tend, end, mem, size);
+}
+
+static const char *fixedpad(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                            void *mem, size_t size)
+{
+    (void)mem; (void)size;
+    return matchfixed(tregex, text, tend, end, tend != 0);
+}
+
+// Through tre_nmatch_scratch with as much memory as tre_scratch_size asks for
+static const char *scratched(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                             void *mem, size_t size)
+{
+    const size_t tlen = tend ? (size_t)(tend - text) : strlen(text);
+    tre_scratch s;
+    (void)mem; (void)size;
+    tre_scratch_init(&s, threadmem + 1, tre_scratch_size(tregex, tlen));
+    return tre_nmatch_scratch(tregex, text, tlen, end, &s);
+}
+
+// Through tre_nmatch_safe with as much memory as tre_scratch_size asks for, which holds its visited bitset
+static const char *safesized(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                             void *mem, size_t size)
+{
+    const size_t tlen = tend ? (size_t)(tend - text) : strlen(text);
+    tre_scratch s;
+    tre_bt bt;
+    (void)mem; (void)size;
+    tre_scratch_init(&s, threadmem + 1, tre_scratch_size(tregex, tlen));
+    btinit(&bt, tregex->nodes + ((tregex->flags & TRE_F_BEGIN) ? 1 : 0), text, text + tlen, s.mem, s.size);
+    if (!bt.visited && tlen < TRE_BITSTATE_BITS / TRE_MAX_NODES)
+        abort(); // too small for a text it fits
+    return tre_nmatch_safe(tregex, text, tlen, end, &s);
+}
+
+static const char *safe(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                        void *mem, size_t size)
+{
+    (void)mem; (void)size;
+    return tre_nmatch_safe(tregex, text, tend ? (size_t)(tend - text) : strlen(text), end, &safescratch);
+}
+
+// Searches a few bytes at a time, the budget varying from call to call
+static const char *resumed(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                           void *mem, size_t size)
+{
+    const size_t tlen = tend ? (size_t)(tend - text) : strlen(text);
+    size_t calls = 0;
+    tre_ctx ctx;
+
+    tre_ctx_init(&ctx, tregex, text, tlen, mem, size);
+    while (tre_ctx_run(&ctx, 1 + calls % 4) == TRE_AGAIN)
+        if (++calls > (3 + 2 * TRE_MAX_NODES) * (tlen + 1))
+            abort(); // no progress
+    if (ctx.start && end) { *end = ctx.end; }
+    return ctx.start;
+}
+
+static const char *eager(const tre_comp *tregex, const char *text, const char *tend, const char **end,
+                         void *mem, size_t size)
+{
+    (void)tregex; (void)mem; (void)size;
+    return tre_dfa_nmatch(eagerdfa, text, tend ? (size_t)(tend - text) : strlen(text), end);
+}
+
+// DFA of tregex as read back from storage, or null if it has none. A table
+// built but not loaded back is a failure.
+static const tre_dfa *dfacompile(const tre_comp *tregex, const char *pattern, size_t *ntests, size_t *nfailed)
+{
+    const size_t n = tre_dfa_build(tregex, dfabuf, sizeof(dfabuf));
+    const tre_dfa *dfa;
+
+    if (!n)
+        return 0;
+    memcpy(dfacopy, dfabuf, n);
+    dfa = tre_dfa_load(dfacopy, n);
+    (*ntests)++;
+    if (!dfa && (*nfailed)++ < 10)
+        fprintf(stderr, "eager-dfa: the table of pattern '%s' was not loaded back\n", pattern);
+    return dfa;
+}
+
+// Engines, the tre_comp flags they need, the scratch memory they get and
+// whether the text is followed by TRE_PADDING bytes
+static struct { const char *name; engine_fn fn; int flags; size_t size; int pad; } engines[] =
+{
+    { "shift-and", matchbits,      TRE_F_BITS,    0,                          0 },
+    { "lazy-dfa",  matchbits,      TRE_F_BITS,    sizeof(scratch) - 1,        0 },
+    { "dfa-flush", matchbits,      TRE_F_BITS,    3 * 32 + 1,                 0 }, // 3 states of a few classes
+    { "bitstate",  matchbacktrack, 0,             sizeof(scratch) - 1,        0 },
+    { "one-pass",  onepass,        TRE_F_ONEPASS, 0,                          0 },
+    { "literal",   matchliteral,   TRE_F_LIT,     sizeof(scratch) - 1,        0 },
+    { "fixed",     fixed,          TRE_F_FIXED,   0,                          0 },
+    { "fixed-pad", fixedpad,       TRE_F_FIXED,   0,                          1 },
+    { "span",      span,           TRE_F_SPAN,    0,                          0 },
+    { "jump",      jump,           TRE_F_JUMP,    0,                          0 },
+    { "jump-memo", jump,           TRE_F_JUMP,    sizeof(scratch) - 1,        0 },
+    { "scratch",   scratched,      0,             0,                          0 },
+    { "safe",      safe,           0,             0,                          0 },
+    { "safe-sized", safesized,     0,             0,                          0 },
+    { "resume",    resumed,        0,             0,                          0 },
+    { "resume-dfa", resumed,       TRE_F_BITS,    3 * 32 + 1,                 0 },
+    { "eager-dfa", eager,          TRE_F_BITS,    0,                          0 },
+};
+
+static void randpattern(char *pattern, int maxatoms)
+{
+    int i, n = 1 + rand() % maxatoms;
+    *pattern = 0;
+    if (rand() % 6 == 0)
+        strcat(pattern, "^");
+    for (i = 0; i < n; i++)
+    {
+        strcat(pattern, atoms[rand() % COUNT(atoms)]);
+        strcat(pattern, quants[rand() % COUNT(quants)]);
+    }
+    if (rand() % 2 == 0)
+        strcat(pattern, "c{0,64}"); // too long to expand, uses counters
+    if (rand() % 6 == 0)
+        strcat(pattern, "$");
+}
+
+static void randtext(char *text, int len)
+{
+    int i;
+    for (i = 0; i < len; i++)
+        text[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    text[len] = 0;
+}
+
+// Checks that every engine takes all of a run longer than the old 40000 limit of '*' and '+',
+// and the old 1024 of '{m,}'
+static void testlong(size_t *ntests, size_t *nfailed)
+{
+    static const char *patterns[] = { "a*b", "a+b", "a*?b", "^a+b$", "[ab]*", "a.+", "a\\w*b", "a{0,2}a*b",
+                                      "a{2,}b", "a{70,}b", "^a{3,}?b" };
+    const size_t len = 100001;
+    const char *m, *e;
+    char *text = malloc(len + 1);
+    size_t i, k;
+    tre_comp tregex;
+    int nul;
+
+    memset(text, 'a', len - 1);
+    text[len - 1] = 'b';
+    text[len] = 0;
+    for (i = 0; i < COUNT(patterns); i++)
+    {
+        tre_compile(patterns[i], &tregex);
+        eagerdfa = dfacompile(&tregex, patterns[i], ntests, nfailed);
+        for (nul = 0; nul < 2; nul++)
+            for (k = 0; k < COUNT(engines); k++)
+            {
+                if ((tregex.flags & engines[k].flags) != engines[k].flags || engines[k].pad ||
+                    (engines[k].fn == eager && !eagerdfa))
+                    continue;
+                (*ntests)++;
+                e = 0;
+                m = engines[k].fn(&tregex, text, nul ? 0 : text + len, &e, scratch + 1, engines[k].size);
+                if (m != text || e != text + len)
+                {
+                    if ((*nfailed)++ < 10)
+                        fprintf(stderr, "%s%s: pattern '%s' on a long run: got [%ld,%ld]\n", engines[k].name,
+                                nul ? " (nul)" : "", patterns[i], m ? (long)(m - text) : -1L, m ? (long)(e - text) : -1L);
+                }
+            }
+    }
+    free(text);
+}
+
+// Counted loops entered at nearly every byte, with many entries alive at once,
+// and runs longer than the 1024 bytes a counter keeps
+static void testcount(size_t *ntests, size_t *nfailed)
+{
+    static const char *patterns[] = { "a.{60}b.{5}", "a.{60}?b\\w{9}", "[ab]{30,40}c[ab]{30}", "a[ab]{100,200}b",
+                                      "b\\D{2,1000}1", "^[ab]{1000,1024}", "a{3,1000}b", "\\w{5,900}$", "[^c]{0,64}c",
+                                      "a{5,}b.{60}", "[ab]{3,}?c.{62}", "a.{0,70}?b*[^1]{2,9}1",
+                                      "\\D{0,9}\\D{0,9}\\D{0,9}\\D{0,9}\\D{0,9}\\D{0,9}\\D{0,9}\\D{0,9}\\D{0,9}c" };
+    const size_t len = 3000;
+    const char *m, *e, *want, *wend;
+    char *text = malloc(len + 1);
+    size_t i, j, k;
+    tre_comp tregex;
+
+    for (i = 0; i < COUNT(patterns); i++)
+    {
+        tre_compile(patterns[i], &tregex);
+        eagerdfa = dfacompile(&tregex, patterns[i], ntests, nfailed);
+        for (j = 0; j < 8; j++)
+        {
+            // Mostly 'a' and 'b', with a rare 'c' or '1' ending the runs
+            for (k = 0; k < len; k++)
+                text[k] = (rand() % 500 == 0) ? "c1"[rand() % 2] : "ab"[rand() % 2];
+            text[len] = 0;
+            wend = 0;
+            want = matchbacktrack(&tregex, text, text + len, &wend, scratch + 1, sizeof(scratch) - 1);
+            for (k = 0; k < COUNT(engines); k++)
+            {
+                if ((tregex.flags & engines[k].flags) != engines[k].flags || engines[k].pad ||
+                    (engines[k].fn == eager && !eagerdfa))
+                    continue;
+                (*ntests)++;
+                e = 0;
+                m = engines[k].fn(&tregex, text, text + len, &e, scratch + 1, engines[k].size);
+                if (m != want || (m && e != wend))
+                {
+                    if ((*nfailed)++ < 10)
+                        fprintf(stderr, "%s: pattern '%s' on a long text: got [%ld,%ld] expected [%ld,%ld]\n",
+                                engines[k].name, patterns[i], m ? (long)(m - text) : -1L, m ? (long)(e - text) : -1L,
+                                want ? (long)(want - text) : -1L, want ? (long)(wend - text) : -1L);
+                }
+            }
+        }
+    }
+    free(text);
+}
+
+// Patterns the backtracker takes exponential time on, and which used to be left to it,
+// searched in linear time by the other engines on 40000-byte texts, as well as a
+// mixed one tre_ctx_run used to search in one call
+static void testsafe(size_t *ntests, size_t *nfailed)
+{
+    static const char *patterns[] = { "[y].{60}\\d*\\d*\\d*\\d*\\d*[z]",
+                                      "\\d{0,9}\\d{0,9}\\d{0,9}\\d{0,9}\\d{0,9}\\d{0,9}\\d{0,9}\\d{0,9}\\d{0,9}[z]",
+                                      "[y].{60,70}?\\d*[z]" };
+    const size_t block = 340, len = 40000 / block * block;
+    const char *m, *e, *want;
+    char *text = malloc(len + 3);
+    size_t i, k;
+    tre_comp tregex;
+    int z;
+
+    for (i = 0; i < COUNT(patterns); i++)
+    {
+        // Blocks of 'y1' x 20 and '1' x 300, or only digits, and at times a 'z' before the last one
+        for (k = 0; k < len; k++)
+            text[k] = (i != 1 && k % block < 40 && k % 2 == 0) ? 'y' : '1';
+        tre_compile(patterns[i], &tregex);
+        eagerdfa = dfacompile(&tregex, patterns[i], ntests, nfailed);
+        for (z = 0; z < 2; z++)
+        {
+            text[len] = z ? 'z' : '1';
+            text[len + 1] = '1';
+            text[len + 2] = 0;
+            want = !z ? 0 : (i != 1) ? text + len - block : text + len - 81;
+            for (k = 0; k < COUNT(engines); k++)
+            {
+                if ((tregex.flags & engines[k].flags) != engines[k].flags || engines[k].pad ||
+                    engines[k].fn == matchbacktrack || (engines[k].fn == eager && !eagerdfa))
+                    continue;
+                (*ntests)++;
+                e = 0;
+                m = engines[k].fn(&tregex, text, text + len + 2, &e, scratch + 1, engines[k].size);
+                if (m != want || (m && e != text + len + 1))
+                {
+                    if ((*nfailed)++ < 10)
+                        fprintf(stderr, "%s: pattern '%s' on a long text: got [%ld,%ld]\n", engines[k].name,
+                                patterns[i], m ? (long)(m - text) : -1L, m ? (long)(e - text) : -1L);
+                }
+            }
+        }
+    }
+    free(text);
+}
+
+// DFAs are refused for patterns they cannot hold, and damaged ones on loading.
+// Those without a last scan, having no greedy quantifier, load and match as well.
+static void testdfa(size_t *ntests, size_t *nfailed)
+{
+    static const char *refused[] = { "[ab]*a[ab][ab][ab][ab][ab][ab][ab][ab]", "a*b*?", "a{2,100}" };
+    static const char *loaded[] = { "abc", "a+?b", "\\d\\d:\\d\\d", "\\w[ab]", "[ab]??", "^a*?b$" };
+    static const char *texts[] = { "xxabcx", "caab", "at 12:34.", " xa b", "ab", "aab", "c" };
+    unsigned char *t = (unsigned char *)dfabuf;
+    const tre_dfa *dfa;
+    const char *m, *e, *want, *wend;
+    tre_comp tregex;
+    size_t i, j, n;
+    int ok[5];
+
+    for (i = 0; i < COUNT(loaded); i++)
+    {
+        (*ntests)++;
+        tre_compile(loaded[i], &tregex);
+        n = tre_dfa_build(&tregex, dfabuf, sizeof(dfabuf));
+        dfa = n ? tre_dfa_load(dfabuf, n) : 0;
+        if (!dfa)
+        {
+            (*nfailed)++;
+            fprintf(stderr, "eager-dfa: pattern '%s' was not built and loaded back\n", loaded[i]);
+            continue;
+        }
+        for (j = 0; j < COUNT(texts); j++)
+        {
+            (*ntests)++;
+            wend = e = 0;
+            want = matchbacktrack(&tregex, texts[j], texts[j] + strlen(texts[j]), &wend, 0, 0);
+            m = tre_dfa_nmatch(dfa, texts[j], strlen(texts[j]), &e);
+            if (m != want || (m && e != wend))
+            {
+                (*nfailed)++;
+                fprintf(stderr, "eager-dfa: loaded pattern '%s' on '%s': got [%ld,%ld] expected [%ld,%ld]\n",
+                        loaded[i], texts[j], m ? (long)(m - texts[j]) : -1L, m ? (long)(e - texts[j]) : -1L,
+                        want ? (long)(want - texts[j]) : -1L, want ? (long)(wend - texts[j]) : -1L);
+            }
+        }
+    }
+
+    for (i = 0; i < COUNT(refused); i++)
+    {
+        (*ntests)++;
+        tre_compile(refused[i], &tregex);
+        if (tre_dfa_build(&tregex, dfabuf, sizeof(dfabuf)))
+        {
+            (*nfailed)++;
+            fprintf(stderr, "eager-dfa: pattern '%s' was not refused\n", refused[i]);
+        }
+    }
+
+    // Checks of the 'a+b' table, ok if set
+    tre_compile("a+b", &tregex);
+    n = tre_dfa_build(&tregex, dfabuf, sizeof(dfabuf));
+    ok[0] = n && tre_dfa_load(dfabuf, n) == (const tre_dfa *)dfabuf;
+    ok[1] = !tre_dfa_build(&tregex, dfabuf, sizeof(tre_dfa) + 256);
+    n = tre_dfa_build(&tregex, dfabuf, sizeof(dfabuf));
+    ok[2] = !tre_dfa_load(dfabuf, n - 1);
+    t[sizeof(tre_dfa) + 256 + 1] = 200;
+    ok[3] = !tre_dfa_load(dfabuf, n);
+    t[0] = 'x';
+    ok[4] = !tre_dfa_load(dfabuf, n);
+    for (i = 0; i < COUNT(ok); i++)
+    {
+        (*ntests)++;
+        if (!ok[i])
+        {
+            (*nfailed)++;
+            fprintf(stderr, "eager-dfa: check %lu of the 'a+b' table failed\n", (unsigned long)i);
+        }
+    }
+}
+
+// Sets of small patterns find the same ones the backtracker does, and refuse
+// patterns past TRE_MAX_SET or their words of state
+static void testset(size_t *ntests, size_t *nfailed)
+{
+    static tre_comp comp[TRE_MAX_SET];
+    char pattern[TRE_MAX_SET][128], text[64];
+    tre_set set;
+    uint64_t want, got;
+    int i, j, k, len;
+
+    for (i = 0; i < NSETS; i++)
+    {
+        tre_set_init(&set);
+        for (k = 0; k < 4 + rand() % (TRE_MAX_SET - 4); k++)
+        {
+            randpattern(pattern[set.n], 2);
+            if (tre_compile(pattern[set.n], &comp[set.n]))
+                tre_set_add(&set, &comp[set.n]);
+        }
+
+        for (j = 0; j < NTEXTS; j++)
+        {
+            len = 1 + rand() % (sizeof(text) - 1);
+            randtext(text, len);
+            want = 0;
+            for (k = 0; k < set.n; k++)
+                if (matchbacktrack(&comp[k], text, text + len, 0, 0, 0))
+                    want |= (uint64_t)1 << k;
+            got = tre_set_nmatch(&set, text, len);
+            (*ntests)++;
+            if (got != want && (*nfailed)++ < 10)
+            {
+                for (k = 0; k < set.n && !(((got ^ want) >> k) & 1); k++) {}
+                fprintf(stderr, "set: pattern %d '%s' of %d on '%s': got %d expected %d\n",
+                        k, pattern[k], set.n, text, (int)((got >> k) & 1), (int)((want >> k) & 1));
+            }
+        }
+    }
+
+    // TRE_MAX_SET patterns of a position, then patterns of 60 positions, a word each
+    (*ntests)++;
+    tre_set_init(&set);
+    tre_compile("a", &comp[0]);
+    for (k = 0; k < TRE_MAX_SET && tre_set_add(&set, &comp[0]); k++) {}
+    if (k != TRE_MAX_SET || tre_set_add(&set, &comp[0]))
+    {
+        (*nfailed)++;
+        fprintf(stderr, "set: %d patterns 'a' taken, not %d\n", set.n, TRE_MAX_SET);
+    }
+    (*ntests)++;
+    tre_set_init(&set);
+    tre_compile("a{60}", &comp[0]);
+    for (k = 0; k < TRE_MAX_SET && tre_set_add(&set, &comp[0]); k++) {}
+    if (k != TRE_SET_WORDS)
+    {
+        (*nfailed)++;
+        fprintf(stderr, "set: %d patterns 'a{60}' taken, not %d\n", set.n, TRE_SET_WORDS);
+    }
+}
+
+// Lexers find the longest token, and the first rule of those matching it
+static void testlexer(size_t *ntests, size_t *nfailed)
+{
+    static tre_comp comp[8]; // of full
+    char rule[8][128], full[8][132], text[32];
+    const char *e, *wend;
+    tre_comp tregex;
+    tre_lexer lex;
+    int i, j, k, t, len, n, got, want;
+
+    for (i = 0; i < NSETS; i++)
+    {
+        tre_lexer_init(&lex);
+        for (n = 0, k = 0; k < 2 + rand() % 7; k++)
+        {
+            randpattern(rule[n], 2);
+            if (!tre_compile(rule[n], &tregex) || !tre_lexer_add(&lex, &tregex))
+                continue;
+            // The rule matching exactly the text given, to find its longest token
+            len = (int)strlen(rule[n]);
+            sprintf(full[n], "%s%s%s", rule[n][0] == '^' ? "" : "^", rule[n], rule[n][len - 1] == '$' ? "" : "$");
+            tre_compile(full[n], &comp[n]);
+            n++;
+        }
+
+        for (j = 0; j < NTEXTS; j++)
+        {
+            len = 1 + rand() % (sizeof(text) - 1);
+            randtext(text, len);
+            want = -1;
+            wend = 0;
+            for (t = len; t > 0 && want < 0; t--)
+                for (k = 0; k < n && want < 0; k++)
+                {
+                    if ((t == len || rule[k][strlen(rule[k]) - 1] != '$') &&
+                        matchbacktrack(&comp[k], text, text + t, 0, 0, 0))
+                    {
+                        want = k;
+                        wend = text + t;
+                    }
+                }
+
+            e = 0;
+            got = tre_lex(&lex, text, len, &e);
+            (*ntests)++;
+            if ((got != want || (got >= 0 && e != wend)) && (*nfailed)++ < 10)
+                fprintf(stderr, "lexer: %d rules on '%s': got rule %d '%s' to %ld, expected %d '%s' to %ld\n",
+                        n, text, got, got >= 0 ? rule[got] : "", got >= 0 ? (long)(e - text) : -1L,
+                        want, want >= 0 ? rule[want] : "", want >= 0 ? (long)(wend - text) : -1L);
+        }
+    }
+}
+
+// Can p..tend be matched from node n, taken cnt times, with at most budget errors
+static int fuzzref(const tre_node *n, unsigned cnt, const char *p, const char *tend, int budget)
+{
+    size_t min, max;
+
+    if (budget < 0)
+        return 0;
+    if (n->type == TRE_NONE || (n->type == TRE_END && n[1].type == TRE_NONE))
+        return budget >= tend - p; // inserted
+
+    quantof(n + 1, &min, &max);
+    if (cnt >= min && fuzzref(nextatom(n), 0, p, tend, budget))
+        return 1;
+    if (cnt < max && p < tend && fuzzref(n, cnt + 1, p + 1, tend, budget - !matchone(n, *p)))
+        return 1; // taken or substituted
+    if (cnt < max && fuzzref(n, cnt + 1, p, tend, budget - 1))
+        return 1; // deleted
+    return p < tend && fuzzref(n, cnt, p + 1, tend, budget - 1); // inserted
+}
+
+// Checks tre_nmatch_fuzzy against trying fuzzref on every span
+static void testfuzzy(size_t *ntests, size_t *nfailed)
+{
+    char pattern[128], text[16];
+    const char *m, *e, *want, *wend;
+    const tre_node *nodes;
+    unsigned k, dist, wdist;
+    int i, j, s, t, b, len;
+    tre_comp tregex;
+
+    for (i = 0; i < NFUZZY; i++)
+    {
+        randpattern(pattern, 3);
+        if (!tre_compile(pattern, &tregex) || !(tregex.flags & TRE_F_BITS) || tregex.fwd.ncnt)
+            continue;
+        nodes = tregex.nodes + ((tregex.flags & TRE_F_BEGIN) ? 1 : 0);
+
+        for (j = 0; j < NTEXTS; j++)
+        {
+            len = 1 + rand() % 8;
+            randtext(text, len);
+            k = rand() % 3;
+
+            want = wend = 0;
+            wdist = k + 1;
+            for (t = 0; t <= len; t++)
+                for (s = 0; s <= t; s++)
+                {
+                    if (((tregex.flags & TRE_F_BEGIN) && s) || ((tregex.flags & TRE_F_END) && t != len))
+                        continue;
+                    for (b = 0; b < (int)wdist && !fuzzref(nodes, 0, text + s, text + t, b); b++)
+                        ;
+                    if (b < (int)wdist)
+                    {
+                        wdist = b;
+                        want = text + s;
+                        wend = text + t;
+                    }
+                }
+
+            (*ntests)++;
+            e = 0;
+            dist = 0;
+            m = tre_nmatch_fuzzy(&tregex, text, len, k, &e, &dist);
+            if (m != want || (m && (e != wend || dist != wdist)))
+            {
+                if ((*nfailed)++ < 10)
+                    fprintf(stderr, "fuzzy: pattern '%s' on '%s' k=%u: got [%ld,%ld] %u expected [%ld,%ld] %u\n",
+                            pattern, text, k,
+                            m ? (long)(m - text) : -1L, m ? (long)(e - text) : -1L, dist,
+                            want ? (long)(want - text) : -1L, want ? (long)(wend - text) : -1L, wdist);
+            }
+        }
+    }
+}
+
+int main()
+{
+    char pattern[128], text[96], *exact, *padded, *t;
+    const char *m, *e, *want, *wend;
+    size_t ntests = 0, nfailed = 0, nfuzzy, nfuzzfailed, k;
+    unsigned char freq[256];
+    int i, j, len, nul;
+    tre_comp tregex;
+
+    srand(1);
+    tre_scratch_init(&safescratch, threadmem + 1, sizeof(threadmem) - 1);
+    randtext(text, sizeof(text) - 1);
+    tre_train_freq(text, sizeof(text) - 1, freq);
+
+    for (i = 0; i < NPATTERNS; i++)
+    {
+        // Every other pattern picks its literal by the frequencies of the texts
+        randpattern(pattern, 5);
+        if (!tre_ncompile_freq(pattern, strlen(pattern), (i & 1) ? freq : 0, &tregex))
+            continue;
+        eagerdfa = dfacompile(&tregex, pattern, &ntests, &nfailed);
+
+        for (j = 0; j < NTEXTS; j++)
+        {
+            len = 1 + rand() % (sizeof(text) - 1);
+            randtext(text, len);
+            wend = 0;
+            want = matchbacktrack(&tregex, text, text + len, &wend, 0, 0);
+
+            // Copies of the text ending where they were allocated, for the sanitizers to
+            // catch reading past them, and followed by padding that matches many atoms
+            exact = malloc(len + 1);
+            padded = malloc(len + 1 + TRE_PADDING);
+            memcpy(exact, text, len + 1);
+            memcpy(padded, text, len + 1);
+            memset(padded + len + 1, 'a', TRE_PADDING - 1);
+
+            // Every other text is given without its end, for the engines to stop at the NUL byte
+            nul = j & 1;
+            for (k = 0; k < COUNT(engines); k++)
+            {
+                if ((tregex.flags & engines[k].flags) != engines[k].flags || (engines[k].fn == eager && !eagerdfa))
+                    continue;
+                ntests++;
+                e = 0;
+                t = engines[k].pad ? padded : exact;
+                // scratch + 1 is misaligned on purpose
+                m = engines[k].fn(&tregex, t, nul ? 0 : t + len, &e, scratch + 1, engines[k].size);
+                if ((m ? m - t : -1) != (want ? want - text : -1) || (m && e - t != wend - text))
+                {
+                    if (nfailed++ < 10)
+                        fprintf(stderr, "%s%s: pattern '%s' on '%s': got [%ld,%ld] expected [%ld,%ld]\n",
+                                engines[k].name, nul ? " (nul)" : "", pattern, text,
+                                m ? (long)(m - t) : -1L, m ? (long)(e - t) : -1L,
+                                want ? (long)(want - text) : -1L, want ? (long)(wend - text) : -1L);
+                }
+            }
+            free(exact);
+            free(padded);
+        }
+    }
+
+    testlong(&ntests, &nfailed);
+    testcount(&ntests, &nfailed);
+    testsafe(&ntests, &nfailed);
+    testdfa(&ntests, &nfailed);
+    testset(&ntests, &nfailed);
+    testlexer(&ntests, &nfailed);
+    printf("%lu/%lu engine tests succeeded, %lu in safe mode fell back.\n", ntests - nfailed, ntests,
+           (unsigned long)safescratch.nfallback);
+    printf("\n");
+
+    nfuzzfailed = 0;
+    nfuzzy = 0;
+    testfuzzy(&nfuzzy, &nfuzzfailed);
+    printf("%lu/%lu fuzzy tests succeeded.\n", nfuzzy - nfuzzfailed, nfuzzy);
+    printf("\n");
+
+    return nfailed != 0 || nfuzzfailed != 0;
+}
@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+
+"""
+  Tests the tre extension built by 'make python': searching bytes, bytearray,
+  memoryview and mmap buffers in place, find_all, search_batch, the empty
+  pattern, errors, and threads searching at once with the GIL released.
+"""
+
+import mmap
+import os
+import sys
+import threading
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "python"))
+import tre
+
+
+ntests = 0
+nfailed = 0
+
+
+def check(ok, what):
+  global ntests, nfailed
+  ntests += 1
+  if not ok:
+    nfailed += 1
+    print("failed: %s" % what)
+
+
+text = b"id=42 size=1024 name=x7"
+digits = tre.compile(rb"\d+")
+
+check(digits.pattern == b"\\d+" and repr(digits) == "tre.compile(b'\\\\d+')", "pattern and repr")
+check(tre.compile("\\d+").pattern == b"\\d+", "str patterns as UTF-8")
+check(digits.search(text) == (3, 5), "search bytes")
+check(digits.search(bytearray(text)) == (3, 5), "search a bytearray")
+check(digits.search(memoryview(text)[5:]) == (6, 10), "search a memoryview slice")
+check(digits.search(b"none") is None, "no match")
+check(digits.search(b"") is None and tre.compile(b"a*").search(b"") == (0, 0), "empty buffers")
+
+check(digits.find_all(text) == [(3, 5), (11, 15), (22, 23)], "find_all")
+check(tre.compile(rb"^\w+").find_all(text) == [(0, 2)], "a '^' pattern matches once")
+check(tre.compile(b"x*").find_all(b"ab") == [(0, 0), (1, 1), (2, 2)], "empty matches move on by a byte")
+check(tre.compile(b"q").find_all(text) == [], "find_all without a match")
+check(tre.compile(b"").search(b"ab") == (0, 0) and tre.compile(b"").search(b"") == (0, 0) and
+      tre.compile(b"").find_all(b"ab") == [(0, 0), (1, 1), (2, 2)], "the empty pattern matches every text")
+
+check(digits.search_batch([text, b"abc", memoryview(b"x9")]) == [(3, 5), None, (1, 2)], "search_batch")
+check(digits.search_batch([]) == [], "search_batch of nothing")
+
+# A text mapped from a file, searched where it is
+with open(__file__, "rb") as f:
+  m = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+  span = tre.compile(b"ntests = \\d").search(m)
+  check(span is not None and m[span[0]:span[1]] == b"ntests = 0", "search an mmap")
+  m.close()
+
+for bad in (b"a{2,1}", b"a" * 70 + b"b"):
+  try:
+    tre.compile(bad)
+    check(False, "tre.error for %r, which does not compile" % (bad,))
+  except tre.error as e:
+    check(isinstance(e, ValueError), "tre.error for %r, which does not compile" % (bad,))
+
+for bad in ("text", 42, [b"ok", "text"]):
+  try:
+    if isinstance(bad, list):
+      digits.search_batch(bad)
+    else:
+      digits.search(bad)
+    check(False, "TypeError for %r" % (bad,))
+  except TypeError:
+    check(True, "TypeError for %r" % (bad,))
+
+# Threads searching the same pattern at once
+big = b"x" * 100000 + b" 12345 "
+results = []
+
+def worker():
+  results.append([digits.search(big), digits.find_all(big[-20:]), digits.search_batch([big, text])])
+
+threads = [threading.Thread(target=worker) for i in range(8)]
+for t in threads:
+  t.start()
+for t in threads:
+  t.join()
+check(len(results) == 8 and all(r == [(100001, 100006), [(14, 19)], [(100001, 100006), (3, 5)]] for r in results),
+      "threads searching at once")
+
+print("%d/%d Python tests succeeded." % (ntests - nfailed, ntests))
+sys.exit(1 if nfailed else 0)